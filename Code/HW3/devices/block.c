@@ -3,7 +3,26 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/io.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Ticks a read or a write may wait in the queue before it is
+   dispatched ahead of the elevator order.  Reads are given the
+   shorter deadline because a thread is usually waiting for
+   them. */
+#define READ_EXPIRE (TIMER_FREQ / 20)
+#define WRITE_EXPIRE (TIMER_FREQ / 2)
+
+/* Most sectors that merged requests may add up to. */
+#define MERGE_MAX 32
+
+/* Request latency histogram: bucket I counts requests that took
+   fewer than 2**(I+1) cycles, the last bucket all the rest. */
+#define LATENCY_BUCKETS 48
 
 /* A block device. */
 struct block
@@ -17,8 +36,33 @@ struct block
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
 
+    struct block *parent;               /* Device holding this partition,
+                                           or null if not a partition. */
+    block_sector_t start;               /* First sector within PARENT. */
+
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+    unsigned long long read_req_cnt;    /* Number of read requests. */
+    unsigned long long write_req_cnt;   /* Number of write requests. */
+
+    /* Request queue, served by the device's I/O thread.  Unused
+       in a partition, whose requests go to its parent's queue. */
+    struct lock queue_lock;             /* Protects the members below. */
+    struct condition queue_nonempty;    /* Signaled on submission. */
+    struct list queue;                  /* Queued requests, by sector. */
+    block_sector_t head;                /* Sector just past the last
+                                           transfer. */
+    unsigned long long next_seq;        /* Next submission number. */
+    uint8_t *merge_buf;                 /* MERGE_MAX sectors for merged
+                                           transfers, or null. */
+
+    unsigned long long merge_cnt;       /* Requests merged into another. */
+    unsigned long long deadline_cnt;    /* Requests dispatched early
+                                           because their deadline
+                                           passed. */
+    long long done_cnt;                 /* Requests completed. */
+    long long latency[LATENCY_BUCKETS]; /* Completed requests by
+                                           latency. */
   };
 
 /* List of all block devices. */
@@ -27,7 +71,11 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 /* The block block assigned to each Pintos role. */
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
+static struct block *block_new (const char *name, enum block_type,
+                                const char *extra_info, block_sector_t size);
 static struct block *list_elem_to_block (struct list_elem *);
+static thread_func block_io_thread NO_RETURN;
+static uint64_t latency_percentile (struct block *, int percent);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -113,6 +161,19 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Submits a request to transfer CNT sectors starting at SECTOR
+   between BLOCK and BUFFER, and waits for it to complete. */
+static void
+block_transfer_wait (struct block *block, block_sector_t sector,
+                     size_t cnt, void *buffer, bool write)
+{
+  struct block_request r;
+
+  block_request_init (&r, sector, cnt, buffer, write);
+  block_submit (block, &r);
+  block_wait (&r);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -120,9 +181,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  block_transfer_wait (block, sector, 1, buffer, false);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +192,363 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  block_transfer_wait (block, sector, 1, (void *) buffer, true);
+}
+
+/* Reads CNT sectors starting at SECTOR from BLOCK into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes.  Uses as
+   few requests as the driver allows.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffer)
+{
+  if (cnt > 0)
+    block_transfer_wait (block, sector, cnt, buffer, false);
+}
+
+/* Writes CNT sectors starting at SECTOR to BLOCK from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Uses as few
+   requests as the driver allows.  Returns after the block device
+   has acknowledged receiving the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      size_t cnt, const void *buffer)
+{
+  if (cnt > 0)
+    block_transfer_wait (block, sector, cnt, (void *) buffer, true);
+}
+
+/* Initializes R as a request to transfer CNT sectors starting at
+   SECTOR between a block device and BUFFER, which must have room
+   for CNT * BLOCK_SECTOR_SIZE bytes: from the device into BUFFER
+   if WRITE is false, from BUFFER to the device if it is true.
+   The request completes by upping a semaphore that block_wait()
+   downs; set R->done to be called back instead. */
+void
+block_request_init (struct block_request *r, block_sector_t sector,
+                    size_t cnt, void *buffer, bool write)
+{
+  ASSERT (cnt > 0);
+
+  r->sector = sector;
+  r->cnt = cnt;
+  r->buffer = buffer;
+  r->write = write;
+  r->done = NULL;
+  r->aux = NULL;
+  sema_init (&r->complete, 0);
+}
+
+/* Adds R's sectors to BLOCK's transfer counts. */
+static void
+count_sectors (struct block *block, const struct block_request *r)
+{
+  if (r->write)
+    block->write_cnt += r->cnt;
+  else
+    block->read_cnt += r->cnt;
+}
+
+/* Queues R on BLOCK and returns at once.  BLOCK's I/O thread
+   carries it out later, in whatever order its scheduler picks,
+   and then completes it as block_request_init() describes.  R
+   and its buffer must stay untouched until then.
+
+   A partition has no queue or I/O thread of its own.  Its
+   requests go straight into the queue of the device holding it,
+   so that device's scheduler sees all of them at once. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  struct list_elem *e;
+
+  check_sector (block, r->sector + r->cnt - 1);
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+
+  r->block = block;
+  if (block->parent != NULL)
+    {
+      r->sector += block->start;
+      block = block->parent;
+    }
+
+  lock_acquire (&block->queue_lock);
+  r->seq = block->next_seq++;
+  r->deadline = timer_ticks () + (r->write ? WRITE_EXPIRE : READ_EXPIRE);
+  r->start = rdtsc ();
+  count_sectors (block, r);
+  if (r->block != block)
+    count_sectors (r->block, r);
+
+  /* Keep the queue sorted by sector, and in submission order
+     among requests for the same sector. */
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    if (list_entry (e, struct block_request, elem)->sector > r->sector)
+      break;
+  list_insert (e, &r->elem);
+  cond_signal (&block->queue_nonempty, &block->queue_lock);
+  lock_release (&block->queue_lock);
+}
+
+/* Waits for R, submitted with block_submit() and without a DONE
+   callback, to complete. */
+void
+block_wait (struct block_request *r)
+{
+  ASSERT (r->done == NULL);
+  sema_down (&r->complete);
+}
+
+/* Returns true if requests A and B touch a common sector and at
+   least one of them writes it, so that they must reach the
+   device in submission order. */
+static bool
+requests_conflict (const struct block_request *a,
+                   const struct block_request *b)
+{
+  return ((a->write || b->write)
+          && a->sector < b->sector + b->cnt
+          && b->sector < a->sector + a->cnt);
+}
+
+/* Returns the oldest request in BLOCK's queue that was submitted
+   before R and conflicts with it, or a null pointer if there is
+   none. */
+static struct block_request *
+oldest_conflict (struct block *block, struct block_request *r)
+{
+  struct block_request *oldest = NULL;
+  struct list_elem *e;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *q = list_entry (e, struct block_request, elem);
+      if (q->seq < r->seq && requests_conflict (q, r)
+          && (oldest == NULL || q->seq < oldest->seq))
+        oldest = q;
+    }
+  return oldest;
+}
+
+/* Chooses the next request to dispatch from BLOCK's queue, which
+   must not be empty.  The oldest request whose deadline has
+   passed goes first; otherwise the scheduler is C-LOOK: the
+   first request at or past the head, wrapping around to the
+   lowest sector when there is none.  Never picks a request ahead
+   of an older one it conflicts with. */
+static struct block_request *
+pick_request (struct block *block)
+{
+  int64_t now = timer_ticks ();
+  struct block_request *r = NULL, *older;
+  struct list_elem *e;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *q = list_entry (e, struct block_request, elem);
+      if (q->deadline <= now && (r == NULL || q->seq < r->seq))
+        r = q;
+    }
+  if (r != NULL)
+    {
+      block->deadline_cnt++;
+      if (r->block != block)
+        r->block->deadline_cnt++;
+    }
+  else
+    {
+      for (e = list_begin (&block->queue); e != list_end (&block->queue);
+           e = list_next (e))
+        {
+          r = list_entry (e, struct block_request, elem);
+          if (r->sector >= block->head)
+            break;
+        }
+      if (e == list_end (&block->queue))
+        r = list_entry (list_front (&block->queue), struct block_request,
+                        elem);
+    }
+
+  while ((older = oldest_conflict (block, r)) != NULL)
+    r = older;
+  return r;
+}
+
+/* Adds CALLS driver requests in the direction given by WRITE to
+   BLOCK's request counts. */
+static void
+count_requests (struct block *block, bool write, size_t calls)
+{
+  if (write)
+    block->write_req_cnt += calls;
+  else
+    block->read_req_cnt += calls;
+}
+
+/* Transfers CNT sectors starting at SECTOR between BLOCK and
+   BUFFER, in the direction given by WRITE, with as few driver
+   calls as the driver allows.  Returns the number of driver
+   calls made. */
+static size_t
+block_transfer (struct block *block, block_sector_t sector, size_t cnt,
+                uint8_t *buffer, bool write)
+{
+  size_t calls = 0;
+
+  while (cnt > 0)
+    {
+      size_t n = cnt < BLOCK_MULTIPLE_MAX ? cnt : BLOCK_MULTIPLE_MAX;
+      size_t i;
+
+      if (write && block->ops->write_multiple != NULL)
+        block->ops->write_multiple (block->aux, sector, n, buffer);
+      else if (!write && block->ops->read_multiple != NULL)
+        block->ops->read_multiple (block->aux, sector, n, buffer);
+      else
+        {
+          for (i = 0; i < n; i++)
+            if (write)
+              block->ops->write (block->aux, sector + i,
+                                 buffer + i * BLOCK_SECTOR_SIZE);
+            else
+              block->ops->read (block->aux, sector + i,
+                                buffer + i * BLOCK_SECTOR_SIZE);
+          calls += n - 1;
+        }
+      calls++;
+      sector += n;
+      buffer += n * BLOCK_SECTOR_SIZE;
+      cnt -= n;
+    }
+  return calls;
+}
+
+/* Records that a request took CYCLES from submission to
+   completion on BLOCK. */
+static void
+record_latency (struct block *block, uint64_t cycles)
+{
+  int bucket = 0;
+
+  while (bucket < LATENCY_BUCKETS - 1 && cycles >= (2ULL << bucket))
+    bucket++;
+  block->latency[bucket]++;
+  block->done_cnt++;
+}
+
+/* Returns an upper bound on the request latency, in cycles, below
+   which PERCENT percent of BLOCK's requests completed. */
+static uint64_t
+latency_percentile (struct block *block, int percent)
+{
+  long long want = (block->done_cnt * percent + 99) / 100;
+  long long seen = 0;
+  int bucket;
+
+  for (bucket = 0; bucket < LATENCY_BUCKETS - 1; bucket++)
+    {
+      seen += block->latency[bucket];
+      if (seen >= want)
+        break;
+    }
+  return 2ULL << bucket;
+}
+
+/* BLOCK's I/O thread.  Repeatedly picks a request, merges into it
+   the queued requests in the same direction that continue it on
+   the device, carries them out with one transfer through the
+   merge buffer, and completes them. */
+static void
+block_io_thread (void *block_)
+{
+  struct block *block = block_;
+
+  for (;;)
+    {
+      struct block_request *r, *last;
+      struct list batch;
+      struct list_elem *e;
+      size_t cnt, calls;
+
+      lock_acquire (&block->queue_lock);
+      while (list_empty (&block->queue))
+        cond_wait (&block->queue_nonempty, &block->queue_lock);
+      r = last = pick_request (block);
+      e = list_remove (&r->elem);
+      list_init (&batch);
+      list_push_back (&batch, &r->elem);
+      cnt = r->cnt;
+      while (block->merge_buf != NULL && e != list_end (&block->queue))
+        {
+          struct block_request *q = list_entry (e, struct block_request,
+                                                elem);
+          if (q->write != r->write || q->sector != last->sector + last->cnt
+              || cnt + q->cnt > MERGE_MAX || oldest_conflict (block, q))
+            break;
+          e = list_remove (e);
+          list_push_back (&batch, &q->elem);
+          cnt += q->cnt;
+          last = q;
+          block->merge_cnt++;
+          if (q->block != block)
+            q->block->merge_cnt++;
+        }
+      block->head = r->sector + cnt;
+      lock_release (&block->queue_lock);
+
+      if (last == r)
+        calls = block_transfer (block, r->sector, cnt, r->buffer, r->write);
+      else
+        {
+          uint8_t *p = block->merge_buf;
+
+          if (r->write)
+            for (e = list_begin (&batch); e != list_end (&batch);
+                 e = list_next (e))
+              {
+                struct block_request *q = list_entry (e, struct block_request,
+                                                      elem);
+                memcpy (p, q->buffer, q->cnt * BLOCK_SECTOR_SIZE);
+                p += q->cnt * BLOCK_SECTOR_SIZE;
+              }
+          calls = block_transfer (block, r->sector, cnt, block->merge_buf,
+                                  r->write);
+          if (!r->write)
+            for (e = list_begin (&batch); e != list_end (&batch);
+                 e = list_next (e))
+              {
+                struct block_request *q = list_entry (e, struct block_request,
+                                                      elem);
+                memcpy (q->buffer, p, q->cnt * BLOCK_SECTOR_SIZE);
+                p += q->cnt * BLOCK_SECTOR_SIZE;
+              }
+        }
+      count_requests (block, r->write, calls);
+      if (r->block != block)
+        count_requests (r->block, r->write, calls);
+
+      while (!list_empty (&batch))
+        {
+          struct block_request *q = list_entry (list_pop_front (&batch),
+                                                struct block_request, elem);
+          uint64_t cycles = rdtsc () - q->start;
+
+          record_latency (block, cycles);
+          if (q->block != block)
+            record_latency (q->block, cycles);
+          if (q->done != NULL)
+            q->done (q);
+          else
+            sema_up (&q->complete);
+        }
+    }
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -171,9 +583,18 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
-          printf ("%s (%s): %llu reads, %llu writes\n",
+          printf ("%s (%s): %llu reads in %llu requests, "
+                  "%llu writes in %llu requests\n",
                   block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
+                  block->read_cnt, block->read_req_cnt,
+                  block->write_cnt, block->write_req_cnt);
+          if (block->done_cnt > 0)
+            printf ("%s (%s): %llu merged, %llu past deadline, "
+                    "latency p50 < %llu, p99 < %llu cycles\n",
+                    block->name, block_type_name (block->type),
+                    block->merge_cnt, block->deadline_cnt,
+                    latency_percentile (block, 50),
+                    latency_percentile (block, 99));
         }
     }
 }
@@ -187,8 +608,55 @@ struct block *
 block_register (const char *name, enum block_type type,
                 const char *extra_info, block_sector_t size,
                 const struct block_operations *ops, void *aux)
+{
+  struct block *block = block_new (name, type, extra_info, size);
+  char thread_name[24];
+
+  block->ops = ops;
+  block->aux = aux;
+  block->merge_buf = palloc_get_multiple (0, MERGE_MAX * BLOCK_SECTOR_SIZE
+                                          / PGSIZE);
+
+  /* The I/O thread runs just above ordinary threads, so that a
+     request is dispatched as soon as it is queued rather than
+     after a CPU-bound thread's time slice, without outranking
+     threads that have raised their own priority. */
+  snprintf (thread_name, sizeof thread_name, "%s-io", block->name);
+  if (thread_create (thread_name, PRI_DEFAULT + 1, block_io_thread, block)
+      == TID_ERROR)
+    PANIC ("%s: cannot start I/O thread", block->name);
+
+  return block;
+}
+
+/* Registers partition NAME of TYPE, SIZE sectors long, starting
+   at sector START of block device PARENT.  EXTRA_INFO is as for
+   block_register().  The partition's requests are carried out by
+   PARENT, see block_submit(). */
+struct block *
+block_register_partition (const char *name, enum block_type type,
+                          const char *extra_info, block_sector_t size,
+                          struct block *parent, block_sector_t start)
+{
+  struct block *block = block_new (name, type, extra_info, size);
+
+  ASSERT (parent->parent == NULL);
+  ASSERT (start + size >= start && start + size <= parent->size);
+
+  block->parent = parent;
+  block->start = start;
+  return block;
+}
+
+/* Creates and announces a block device with the given NAME, TYPE,
+   EXTRA_INFO and SIZE, with no driver and an empty request
+   queue. */
+static struct block *
+block_new (const char *name, enum block_type type,
+           const char *extra_info, block_sector_t size)
 {
   struct block *block = malloc (sizeof *block);
+
   if (block == NULL)
     PANIC ("Failed to allocate memory for block device descriptor");
 
@@ -196,10 +664,23 @@ block_register (const char *name, enum block_type type,
   strlcpy (block->name, name, sizeof block->name);
   block->type = type;
   block->size = size;
-  block->ops = ops;
-  block->aux = aux;
+  block->ops = NULL;
+  block->aux = NULL;
+  block->parent = NULL;
+  block->start = 0;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->read_req_cnt = 0;
+  block->write_req_cnt = 0;
+  lock_init (&block->queue_lock);
+  cond_init (&block->queue_nonempty);
+  list_init (&block->queue);
+  block->head = 0;
+  block->next_seq = 0;
+  block->merge_buf = NULL;
+  block->merge_cnt = block->deadline_cnt = 0;
+  block->done_cnt = 0;
+  memset (block->latency, 0, sizeof block->latency);
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -210,7 +691,7 @@ block_register (const char *name, enum block_type type,
 
   return block;
 }
-
+
 /* Returns the block device corresponding to LIST_ELEM, or a null
    pointer if LIST_ELEM is the list end of all_blocks. */
 static struct block *
@@ -2,7 +2,10 @@
 #define DEVICES_BLOCK_H
 
 #include <stddef.h>
+#include <stdbool.h>
 #include <inttypes.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,9 +56,46 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous requests.
+   block_read() and friends submit one of these and wait for it.
+   Callers that want several transfers in flight at once, so that
+   the device's scheduler can order and merge them, submit their
+   own. */
+struct block_request
+  {
+    /* Set by block_request_init(). */
+    block_sector_t sector;              /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+    void *buffer;                       /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    bool write;                         /* Write, as opposed to read? */
+    void (*done) (struct block_request *); /* If nonnull, called by the
+                                              I/O thread on completion. */
+    void *aux;                          /* For DONE's use. */
+
+    /* Owned by the block layer.  block_submit() also rewrites
+       SECTOR as a sector of the underlying device when the request
+       is for a partition. */
+    struct block *block;                /* Device submitted to. */
+    struct list_elem elem;              /* Element in device queue. */
+    struct semaphore complete;          /* Up'd on completion. */
+    unsigned long long seq;             /* Submission number. */
+    int64_t deadline;                   /* Timer tick to dispatch by. */
+    uint64_t start;                     /* Time-stamp counter at
+                                           submission. */
+  };
+
+void block_request_init (struct block_request *, block_sector_t,
+                         size_t cnt, void *buffer, bool write);
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+
 /* Statistics. */
 void block_print_stats (void);
 
@@ -65,10 +105,26 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional: transfer CNT consecutive sectors with one request.
+       CNT is at most BLOCK_MULTIPLE_MAX. */
+    void (*read_multiple) (void *aux, block_sector_t, size_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *buffer);
   };
 
+/* Most sectors a driver's read_multiple or write_multiple is asked
+   to transfer at once. */
+#define BLOCK_MULTIPLE_MAX 256
+
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
+struct block *block_register_partition (const char *name, enum block_type,
+                                        const char *extra_info,
+                                        block_sector_t size,
+                                        struct block *parent,
+                                        block_sector_t start);
 
 #endif /* devices/block.h */
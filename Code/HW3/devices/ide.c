@@ -8,10 +8,18 @@
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   If the PCI bus has a bus master IDE controller, such as the
+   PIIX that QEMU emulates, sectors are moved by DMA, so that the
+   CPU is free to run other threads during the transfer.
+   Otherwise, or with the "-pio" kernel option, the CPU copies
+   each sector through the data register. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -30,10 +38,24 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
+
+/* Bus Master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* 1=device to memory, 0=memory to device. */
+
+/* Bus Master Status Register bits.  Writing 1 clears ERR and INT. */
+#define BM_ST_ERR 0x02          /* Transfer failed. */
+#define BM_ST_INT 0x04          /* Device interrupted. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +71,26 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+
+/* PCI configuration space access, mechanism #1. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* A physical region descriptor, which tells the bus master where
+   in memory to move the next part of a transfer.  A region may
+   not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes, 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT in the last descriptor. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +99,15 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    bool dma;                   /* Transfer by DMA? */
+    int multiple;               /* Sectors per interrupt with READ/WRITE
+                                   MULTIPLE, or 0 if not enabled. */
+
+    /* Statistics. */
+    unsigned long long dma_cnt;   /* Sectors moved by DMA. */
+    unsigned long long pio_cnt;   /* Sectors moved by PIO. */
+    uint64_t busy_cycles;         /* CPU cycles spent on transfers,
+                                     not counting time asleep. */
   };
 
 /* An ATA channel (aka controller).
@@ -72,6 +123,9 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus master base port, or 0 if none. */
+    struct prd *prdt;           /* PRD table, in its own page. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -79,16 +133,24 @@ struct channel
 #define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
 
+/* If true, never use DMA.
+   Controlled by kernel command-line option "-pio". */
+bool ide_pio_only;
+
 static struct block_operations ide_operations;
 
+static uint16_t find_bus_master (void);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
-static void issue_pio_command (struct channel *, uint8_t command);
+static void select_sectors (struct ata_disk *, block_sector_t, size_t cnt);
+static void issue_command (struct channel *, uint8_t command);
+static uint64_t wait_for_interrupt (struct channel *);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
+static bool dma_transfer (struct ata_disk *, block_sector_t, size_t cnt,
+                          void *buffer, bool write, uint64_t *slept);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
@@ -101,6 +163,7 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = ide_pio_only ? 0 : find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -126,6 +189,10 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->bm_base = 0;
+      c->prdt = bm_base != 0 ? palloc_get_page (0) : NULL;
+      if (c->prdt != NULL)
+        c->bm_base = bm_base + chan_no * 8;
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +203,10 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->dma = false;
+          d->multiple = 0;
+          d->dma_cnt = d->pio_cnt = 0;
+          d->busy_cycles = 0;
         }
 
       /* Register interrupt handler. */
@@ -155,10 +226,88 @@ ide_init (void)
     }
 }
 
+/* Prints statistics for each ATA disk. */
+void
+ide_print_stats (void) 
+{
+  size_t chan_no;
+  int dev_no;
+
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    for (dev_no = 0; dev_no < 2; dev_no++)
+      {
+        struct ata_disk *d = &channels[chan_no].devices[dev_no];
+        unsigned long long sectors = d->dma_cnt + d->pio_cnt;
+
+        if (d->is_ata && sectors > 0)
+          printf ("%s: %llu DMA sectors, %llu PIO sectors, "
+                  "%llu CPU cycles per MB\n",
+                  d->name, d->dma_cnt, d->pio_cnt,
+                  d->busy_cycles * (1024 * 1024 / BLOCK_SECTOR_SIZE)
+                  / sectors);
+      }
+}
+
 /* Disk detection and identification. */
 
 static char *descramble_ata_string (char *, int size);
 
+/* Reads 32-bit register REG of PCI function BUS:DEV.FUNC. */
+static uint32_t
+pci_read_config (int bus, int dev, int func, int reg) 
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to 32-bit register REG of PCI function
+   BUS:DEV.FUNC. */
+static void
+pci_write_config (int bus, int dev, int func, int reg, uint32_t value) 
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller that can act as a bus
+   master and drives the legacy channels at their legacy ports.
+   If one is found, enables bus mastering on it and returns its
+   bus master base port, whose first 8 ports serve channel 0 and
+   next 8 channel 1.  Otherwise returns 0. */
+static uint16_t
+find_bus_master (void) 
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t class = pci_read_config (0, dev, func, 0x08) >> 8;
+        uint32_t bar4;
+
+        /* Class 01h, subclass 01h is IDE.  In the programming
+           interface, bit 7 means bus master capable and bits 0
+           and 2 mean a channel is in native rather than legacy
+           mode. */
+        if ((pci_read_config (0, dev, func, 0x00) & 0xffff) == 0xffff
+            || (class >> 8) != 0x0101
+            || (class & 0x85) != 0x80)
+          continue;
+
+        bar4 = pci_read_config (0, dev, func, 0x20);
+        if ((bar4 & 1) == 0 || (bar4 & 0xfffc) == 0)
+          continue;
+
+        /* Enable I/O space and bus master. */
+        pci_write_config (0, dev, func, 0x04,
+                          pci_read_config (0, dev, func, 0x04) | 0x05);
+        return bar4 & 0xfffc;
+      }
+  return 0;
+}
+
 /* Resets an ATA channel and waits for any devices present on it
    to finish the reset. */
 static void
@@ -265,6 +414,7 @@ identify_ata_device (struct ata_disk *d)
   char *model, *serial;
   char extra_info[128];
   struct block *block;
+  int multiple;
 
   ASSERT (d->is_ata);
 
@@ -272,7 +422,7 @@ identify_ata_device (struct ata_disk *d)
      indicating the device's response is ready, and read the data
      into our buffer. */
   select_device_wait (d);
-  issue_pio_command (c, CMD_IDENTIFY_DEVICE);
+  issue_command (c, CMD_IDENTIFY_DEVICE);
   sema_down (&c->completion_wait);
   if (!wait_while_busy (d))
     {
@@ -284,6 +434,7 @@ identify_ata_device (struct ata_disk *d)
   /* Calculate capacity.
      Read model name and serial number. */
   capacity = *(uint32_t *) &id[60 * 2];
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x100) != 0;
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
   snprintf (extra_info, sizeof extra_info,
@@ -303,6 +454,23 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Let PIO transfers of several sectors use READ MULTIPLE and
+     WRITE MULTIPLE, which interrupt once per block of sectors
+     instead of once per sector.  The block size must be a power
+     of 2 no bigger than the disk's maximum. */
+  multiple = *(uint8_t *) &id[47 * 2];
+  while ((multiple & (multiple - 1)) != 0)
+    multiple &= multiple - 1;
+  if (multiple > 1)
+    {
+      select_device_wait (d);
+      outb (reg_nsect (c), multiple);
+      issue_command (c, CMD_SET_MULTIPLE_MODE);
+      sema_down (&c->completion_wait);
+      if ((inb (reg_status (c)) & STA_ERR) == 0)
+        d->multiple = multiple;
+    }
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
@@ -337,6 +505,71 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
+/* Transfers CNT sectors starting at SEC_NO between disk D and
+   BUFFER with a single command: from the disk into BUFFER if
+   WRITE is false, from BUFFER to the disk if it is true.  Uses
+   DMA when D supports it and BUFFER is in the kernel's mapping of
+   physical memory, PIO otherwise, with READ/WRITE MULTIPLE if
+   there is more than one sector.  Returns after the disk has
+   acknowledged the command. */
+static void
+ide_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              void *buffer, bool write)
+{
+  struct channel *c = d->channel;
+  uint8_t *p = buffer;
+  uint64_t start, slept = 0;
+  bool ok = true;
+  size_t i, j;
+
+  lock_acquire (&c->lock);
+  start = rdtsc ();
+  if (d->dma && is_kernel_vaddr (buffer) && ((uintptr_t) buffer & 1) == 0)
+    {
+      ok = dma_transfer (d, sec_no, cnt, buffer, write, &slept);
+      d->dma_cnt += cnt;
+    }
+  else
+    {
+      size_t block = cnt > 1 && d->multiple > 1 ? d->multiple : 1;
+
+      select_sectors (d, sec_no, cnt);
+      if (block > 1)
+        issue_command (c, write ? CMD_WRITE_MULTIPLE : CMD_READ_MULTIPLE);
+      else
+        issue_command (c, (write ? CMD_WRITE_SECTOR_RETRY
+                           : CMD_READ_SECTOR_RETRY));
+      for (i = 0; i < cnt; i += block)
+        {
+          size_t n = cnt - i < block ? cnt - i : block;
+
+          /* A read interrupts when each block is ready, a write
+             after taking each one. */
+          if (!write)
+            slept += wait_for_interrupt (c);
+          if (!wait_while_busy (d))
+            {
+              ok = false;
+              break;
+            }
+          for (j = i; j < i + n; j++)
+            if (write)
+              output_sector (c, p + j * BLOCK_SECTOR_SIZE);
+            else
+              input_sector (c, p + j * BLOCK_SECTOR_SIZE);
+          if (write)
+            slept += wait_for_interrupt (c);
+        }
+      d->pio_cnt += cnt;
+    }
+  d->busy_cycles += rdtsc () - start - slept;
+  lock_release (&c->lock);
+
+  if (!ok)
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+           d->name, write ? "write" : "read", sec_no);
+}
+
 /* Reads sector SEC_NO from disk D into BUFFER, which must have
    room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to disks, so external
@@ -344,16 +577,7 @@ descramble_ata_string (char *string, int size)
 static void
 ide_read (void *d_, block_sector_t sec_no, void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  ide_transfer (d_, sec_no, 1, buffer, false);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -364,36 +588,48 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
 static void
 ide_write (void *d_, block_sector_t sec_no, const void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  ide_transfer (d_, sec_no, 1, (void *) buffer, true);
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER
+   with a single command. */
+static void
+ide_read_multiple (void *d_, block_sector_t sec_no, size_t cnt, void *buffer)
+{
+  ide_transfer (d_, sec_no, cnt, buffer, false);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER
+   with a single command. */
+static void
+ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                    const void *buffer)
+{
+  ide_transfer (d_, sec_no, cnt, (void *) buffer, true);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple
   };
+
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT, 1 to 256, to the disk's
+   sector selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sectors (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= BLOCK_MULTIPLE_MAX);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt);    /* 256 wraps to 0, which means 256. */
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -404,7 +640,7 @@ select_sector (struct ata_disk *d, block_sector_t sec_no)
 /* Writes COMMAND to channel C and prepares for receiving a
    completion interrupt. */
 static void
-issue_pio_command (struct channel *c, uint8_t command) 
+issue_command (struct channel *c, uint8_t command) 
 {
   /* Interrupts must be enabled or our semaphore will never be
      up'd by the completion handler. */
@@ -414,6 +650,65 @@ issue_pio_command (struct channel *c, uint8_t command)
   outb (reg_command (c), command);
 }
 
+/* Sleeps until channel C's completion interrupt arrives.
+   Returns the CPU cycles spent asleep. */
+static uint64_t
+wait_for_interrupt (struct channel *c) 
+{
+  uint64_t start = rdtsc ();
+  sema_down (&c->completion_wait);
+  return rdtsc () - start;
+}
+
+/* Moves CNT sectors starting at SEC_NO between disk D and BUFFER
+   by DMA, in the direction given by WRITE as for ide_transfer().
+   The CPU only sets up the PRD table and the command; the thread
+   sleeps while the controller moves the data.  Adds the cycles
+   spent asleep to *SLEPT.  Returns true if successful. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              void *buffer, bool write, uint64_t *slept)
+{
+  struct channel *c = d->channel;
+  uintptr_t paddr = vtop (buffer);
+  size_t left = cnt * BLOCK_SECTOR_SIZE;
+  struct prd *prd = c->prdt;
+  uint8_t command = write ? 0 : BM_CMD_READ;
+  uint8_t status;
+
+  /* The kernel maps physical memory contiguously, so BUFFER only
+     needs splitting at 64 kB boundaries. */
+  for (;;)
+    {
+      size_t size = 0x10000 - (paddr & 0xffff);
+      if (size > left)
+        size = left;
+      prd->addr = paddr;
+      prd->size = size & 0xffff;
+      prd->flags = size == left ? PRD_EOT : 0;
+      paddr += size;
+      left -= size;
+      if (left == 0)
+        break;
+      prd++;
+    }
+
+  /* Program the bus master, then the disk, then start the
+     transfer, as the bus master IDE specification requires. */
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), command);
+  outb (reg_bm_status (c), BM_ST_ERR | BM_ST_INT);
+  select_sectors (d, sec_no, cnt);
+  issue_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), command | BM_CMD_START);
+  *slept += wait_for_interrupt (c);
+  outb (reg_bm_command (c), command);
+
+  status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), BM_ST_ERR | BM_ST_INT);
+  return (status & BM_ST_ERR) == 0 && (inb (reg_status (c)) & STA_ERR) == 0;
+}
+
 /* Reads a sector from channel C's data register in PIO mode into
    SECTOR, which must have room for BLOCK_SECTOR_SIZE bytes. */
 static void
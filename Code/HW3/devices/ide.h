@@ -1,6 +1,13 @@
 #ifndef DEVICES_IDE_H
 #define DEVICES_IDE_H
 
+#include <stdbool.h>
+
+/* If true, never use DMA.
+   Controlled by kernel command-line option "-pio". */
+extern bool ide_pio_only;
+
 void ide_init (void);
+void ide_print_stats (void);
 
 #endif /* devices/ide.h */
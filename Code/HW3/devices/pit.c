@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -81,3 +78,42 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Programs channel 0 to raise interrupt line 0 once, after COUNT
+   PIT cycles, and then stay quiet (mode 0).  COUNT must be
+   between 1 and 65535.  The periodic timer is restarted with
+   pit_configure_channel(). */
+void
+pit_oneshot (unsigned count)
+{
+  enum intr_level old_level;
+
+  ASSERT (count > 0 && count <= 0xffff);
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, 0x30);
+  outb (PIT_PORT_COUNTER (0), count);
+  outb (PIT_PORT_COUNTER (0), count >> 8);
+  intr_set_level (old_level);
+}
+
+/* Returns the number of PIT cycles left before the one-shot
+   started by pit_oneshot() fires, or 0 if it already has. */
+unsigned
+pit_oneshot_remaining (void)
+{
+  enum intr_level old_level;
+  uint8_t status;
+  unsigned count;
+
+  /* Read-back command: latch channel 0's status and count. */
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, 0xc2);
+  status = inb (PIT_PORT_COUNTER (0));
+  count = inb (PIT_PORT_COUNTER (0));
+  count |= inb (PIT_PORT_COUNTER (0)) << 8;
+  intr_set_level (old_level);
+
+  /* In mode 0 the output goes high at terminal count. */
+  return status & 0x80 ? 0 : count;
+}
@@ -1,7 +1,8 @@
 #include "devices/serial.h"
 #include <debug.h>
+#include <stdio.h>
+#include <string.h>
 #include "devices/input.h"
-#include "devices/intq.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
@@ -33,6 +34,11 @@
 #define MCR_REG (IO_BASE + 4)   /* MODEM Control Register. */
 #define LSR_REG (IO_BASE + 5)   /* Line Status Register (read-only). */
 
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable receive and transmit FIFOs. */
+#define FCR_CLEAR 0x06          /* Clear both FIFOs. */
+#define TX_FIFO_SIZE 16         /* Bytes the transmit FIFO holds. */
+
 /* Interrupt Enable Register bits. */
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
@@ -47,15 +53,36 @@
 /* Line Status Register. */
 #define LSR_DR 0x01             /* Data Ready: received data byte is in RBR. */
 #define LSR_THRE 0x20           /* THR Empty. */
+#define LSR_TEMT 0x40           /* Transmitter Empty: nothing left to send. */
 
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
-static struct intq txq;
+/* Data to be transmitted.
+   Only writers, with interrupts off, advance tx_head, and only the
+   interrupt handler advances tx_tail, except that writers that
+   cannot wait and serial_flush() take bytes themselves, also with
+   interrupts off.  Both count up forever; the ring holds
+   tx_head - tx_tail bytes. */
+#define TX_RING_SIZE 16384      /* Power of 2. */
+static uint8_t tx_ring[TX_RING_SIZE];
+static volatile uint32_t tx_head, tx_tail;
+
+/* Threads waiting for the ring to drain, and how many. */
+static struct semaphore tx_room;
+static int tx_waiters;
+
+/* If true, output that finds the ring full is dropped rather than
+   waited for.
+   Controlled by kernel command-line option "-serial-drop". */
+bool serial_drop;
+
+/* Statistics. */
+static long long tx_bytes, tx_poll_cnt, tx_wait_cnt, tx_drop_cnt;
 
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
+static void tx_poll (void);
 static void write_ier (void);
 static intr_handler_func serial_interrupt;
 
@@ -71,7 +98,7 @@ init_poll (void)
   outb (FCR_REG, 0);                    /* Disable FIFO. */
   set_serial (9600);                    /* 9.6 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
-  intq_init (&txq);
+  sema_init (&tx_room, 0);
   mode = POLL;
 } 
 
@@ -88,8 +115,15 @@ serial_init_queue (void)
   ASSERT (mode == POLL);
 
   intr_register_ext (0x20 + 4, serial_interrupt, "serial");
-  mode = QUEUE;
   old_level = intr_disable ();
+
+  /* Turn on the FIFOs, so that each transmit interrupt can send
+     TX_FIFO_SIZE bytes, once the last polled byte is out. */
+  while ((inb (LSR_REG) & LSR_TEMT) == 0)
+    continue;
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR);
+
+  mode = QUEUE;
   write_ier ();
   intr_set_level (old_level);
 }
@@ -98,34 +132,70 @@ serial_init_queue (void)
 void
 serial_putc (uint8_t byte) 
 {
+  serial_putbuf (&byte, 1);
+}
+
+/* Sends the N bytes in BUFFER to the serial port.
+   Once interrupt-driven I/O is set up, copies them into the
+   transmit ring and returns; the interrupt handler sends them.
+   If the ring fills, waits for it to drain, or with "-serial-drop"
+   drops the rest of BUFFER.  A caller with interrupts off cannot
+   wait, so it sends bytes from the ring by polling instead. */
+void
+serial_putbuf (const void *buffer, size_t n) 
+{
+  const uint8_t *p = buffer;
   enum intr_level old_level = intr_disable ();
 
   if (mode != QUEUE)
     {
       /* If we're not set up for interrupt-driven I/O yet,
-         use dumb polling to transmit a byte. */
+         use dumb polling to transmit. */
       if (mode == UNINIT)
         init_poll ();
-      putc_poll (byte); 
+      while (n-- > 0)
+        putc_poll (*p++);
+      intr_set_level (old_level);
+      return;
     }
-  else 
+
+  while (n > 0)
     {
-      /* Otherwise, queue a byte and update the interrupt enable
-         register. */
-      if (old_level == INTR_OFF && intq_full (&txq)) 
+      size_t room = TX_RING_SIZE - (tx_head - tx_tail);
+      size_t ofs = tx_head % TX_RING_SIZE;
+      size_t chunk;
+
+      if (room == 0)
         {
-          /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-          putc_poll (intq_getc (&txq)); 
+          if (serial_drop)
+            {
+              tx_drop_cnt += n;
+              break;
+            }
+          else if (old_level == INTR_OFF)
+            tx_poll ();
+          else
+            {
+              /* Interrupts stay off until we block, so the handler
+                 cannot miss that we are waiting. */
+              tx_waiters++;
+              tx_wait_cnt++;
+              write_ier ();
+              sema_down (&tx_room);
+            }
+          continue;
         }
 
-      intq_putc (&txq, byte); 
-      write_ier ();
+      chunk = n < room ? n : room;
+      if (chunk > TX_RING_SIZE - ofs)
+        chunk = TX_RING_SIZE - ofs;
+      memcpy (tx_ring + ofs, p, chunk);
+      tx_head += chunk;
+      tx_bytes += chunk;
+      p += chunk;
+      n -= chunk;
     }
-  
+  write_ier ();
   intr_set_level (old_level);
 }
 
@@ -135,11 +205,20 @@ void
 serial_flush (void) 
 {
   enum intr_level old_level = intr_disable ();
-  while (!intq_empty (&txq))
-    putc_poll (intq_getc (&txq));
+  while (tx_head != tx_tail)
+    tx_poll ();
   intr_set_level (old_level);
 }
 
+/* Prints serial port statistics. */
+void
+serial_print_stats (void) 
+{
+  printf ("Serial: %lld bytes queued, %lld polled, %lld waits, "
+          "%lld dropped\n",
+          tx_bytes, tx_poll_cnt, tx_wait_cnt, tx_drop_cnt);
+}
+
 /* The fullness of the input buffer may have changed.  Reassess
    whether we should block receive interrupts.
    Called by the input buffer routines when characters are added
@@ -182,7 +261,7 @@ write_ier (void)
 
   /* Enable transmit interrupt if we have any characters to
      transmit. */
-  if (!intq_empty (&txq))
+  if (tx_head != tx_tail)
     ier |= IER_XMIT;
 
   /* Enable receive interrupt if we have room to store any
@@ -205,6 +284,16 @@ putc_poll (uint8_t byte)
   outb (THR_REG, byte);
 }
 
+/* Sends the oldest byte in the transmit ring by polling. */
+static void
+tx_poll (void) 
+{
+  ASSERT (tx_head != tx_tail);
+  putc_poll (tx_ring[tx_tail % TX_RING_SIZE]);
+  tx_tail++;
+  tx_poll_cnt++;
+}
+
 /* Serial interrupt handler. */
 static void
 serial_interrupt (struct intr_frame *f UNUSED) 
@@ -218,10 +307,22 @@ serial_interrupt (struct intr_frame *f UNUSED)
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+  /* Once the transmit FIFO is empty, refill it from the ring. */
+  if ((inb (LSR_REG) & LSR_THRE) != 0)
+    {
+      int i;
+
+      for (i = 0; i < TX_FIFO_SIZE && tx_head != tx_tail; i++)
+        {
+          outb (THR_REG, tx_ring[tx_tail % TX_RING_SIZE]);
+          tx_tail++;
+        }
+    }
+
+  /* Wake writers waiting for room once half the ring is free. */
+  if (tx_waiters > 0 && tx_head - tx_tail <= TX_RING_SIZE / 2)
+    for (; tx_waiters > 0; tx_waiters--)
+      sema_up (&tx_room);
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
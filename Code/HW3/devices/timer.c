@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include "devices/pit.h"
 #include "threads/interrupt.h"
+#include "threads/io.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
   
@@ -20,11 +21,34 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* If true, the idle thread stops the periodic timer interrupt
+   until the next sleeper is due.
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* PIT cycles per timer tick, and the most ticks a one-shot can
+   cover with the PIT's 16-bit counter. */
+#define PIT_TICK ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+#define ONESHOT_MAX_TICKS (0xffff / PIT_TICK)
+
+/* Ticks covered by the pending one-shot interrupt, or 0 if the
+   timer is periodic. */
+static int oneshot_ticks;
+
+/* Timer interrupts skipped by tickless idle. */
+static int64_t avoided_interrupts;
+
+/* CPU cycles spent in the timer interrupt handler, in total
+   and in the longest single call. */
+static uint64_t interrupt_cycles;
+static uint64_t interrupt_max_cycles;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
 static intr_handler_func timer_interrupt;
+static void oneshot_cut (unsigned remaining);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -84,6 +108,31 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
+/* Returns the total number of CPU cycles spent in the timer
+   interrupt handler since the OS booted. */
+uint64_t
+timer_interrupt_cycles (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  uint64_t cycles = interrupt_cycles;
+  intr_set_level (old_level);
+  return cycles;
+}
+
+/* Returns the most CPU cycles spent in a single call to the
+   timer interrupt handler since the last call to this function.
+   The handler runs with interrupts off, so this bounds how long
+   it delays other interrupts. */
+uint64_t
+timer_interrupt_max_cycles (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  uint64_t cycles = interrupt_max_cycles;
+  interrupt_max_cycles = 0;
+  intr_set_level (old_level);
+  return cycles;
+}
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
    be turned on. */
 void
@@ -92,8 +141,7 @@ timer_sleep (int64_t ticks)
   int64_t start = timer_ticks ();
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  thread_sleep (start + ticks);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -164,14 +212,126 @@ void
 timer_print_stats (void) 
 {
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  if (timer_tickless)
+    printf ("Timer: %"PRId64" interrupts avoided by tickless idle\n",
+            avoided_interrupts);
+}
+
+/* Called by the idle thread, with interrupts off, to re-enable
+   interrupts and wait for the next one.
+
+   With -tickless, if no sleeper is due on the next tick, the PIT
+   is first switched to a one-shot that fires when the next one
+   is, or as far ahead as its counter allows.  Under the MLFQS the
+   one-shot also stops at the next whole second, so that
+   mlfqs_recalc() still runs on time.  The idle thread accrues no
+   recent_cpu, so nothing else depends on the skipped ticks. */
+void
+timer_idle (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (timer_tickless)
+    {
+      int skip = thread_ticks_to_wakeup (ticks, ONESHOT_MAX_TICKS);
+
+      if (thread_mlfqs && skip > TIMER_FREQ - ticks % TIMER_FREQ)
+        skip = TIMER_FREQ - ticks % TIMER_FREQ;
+      if (skip > 1)
+        {
+          oneshot_ticks = skip;
+          pit_oneshot (skip * PIT_TICK);
+        }
+    }
+
+  /* The `sti' instruction disables interrupts until the
+     completion of the next instruction, so these two
+     instructions are executed atomically.  This atomicity is
+     important; otherwise, an interrupt could be handled
+     between re-enabling interrupts and waiting for the next
+     one to occur, wasting as much as one clock tick worth of
+     time.
+
+     See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
+     7.11.1 "HLT Instruction". */
+  asm volatile ("sti; hlt" : : : "memory");
+
+  /* Some other interrupt may have ended the wait before the
+     one-shot fired.  Cut it short, since a thread is probably
+     about to run.  If the one-shot has fired but not yet been
+     handled, the handler accounts for it. */
+  intr_disable ();
+  if (oneshot_ticks > 0)
+    {
+      unsigned remaining = pit_oneshot_remaining ();
+      if (remaining > 0)
+        oneshot_cut (remaining);
+    }
+}
+
+/* Ends the pending one-shot, which has REMAINING PIT cycles left
+   to run, before it fires.  Counts the whole ticks that have
+   passed since it was armed, then re-arms it for just the rest
+   of the current tick, so that the partial tick is not lost and
+   the periodic timer resumes in phase.  Interrupts must be off. */
+static void
+oneshot_cut (unsigned remaining)
+{
+  unsigned passed = oneshot_ticks * PIT_TICK - remaining;
+  int elapsed = passed / PIT_TICK;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  ticks += elapsed;
+  avoided_interrupts += elapsed;
+  oneshot_ticks = 1;
+  pit_oneshot (PIT_TICK - passed % PIT_TICK);
 }
 
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
+  uint64_t start = rdtsc ();
+  uint64_t cycles;
+
+  /* A one-shot from timer_idle() stands in for several ticks,
+     but only once the PIT says it has reached its terminal
+     count.  Otherwise this is a periodic tick that was latched
+     just before the one-shot was armed: count it as one tick and
+     credit only the time the one-shot has actually run. */
+  if (oneshot_ticks > 0)
+    {
+      unsigned remaining = pit_oneshot_remaining ();
+      if (remaining == 0)
+        {
+          ticks += oneshot_ticks - 1;
+          avoided_interrupts += oneshot_ticks - 1;
+          oneshot_ticks = 0;
+          pit_configure_channel (0, 2, TIMER_FREQ);
+        }
+      else
+        oneshot_cut (remaining);
+    }
+
   ticks++;
   thread_tick ();
+
+  if (thread_mlfqs)
+    {
+      mlfqs_increment ();
+      if (ticks % TIMER_FREQ == 0)
+        mlfqs_recalc ();
+      else if (ticks % 4 == 0)
+        mlfqs_priority (thread_current ());
+    }
+
+  thread_awake (ticks);
+
+  cycles = rdtsc () - start;
+  interrupt_cycles += cycles;
+  if (cycles > interrupt_max_cycles)
+    interrupt_max_cycles = cycles;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
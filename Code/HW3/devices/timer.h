@@ -2,6 +2,7 @@
 #define DEVICES_TIMER_H
 
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
@@ -12,6 +13,8 @@ void timer_calibrate (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
+uint64_t timer_interrupt_cycles (void);
+uint64_t timer_interrupt_max_cycles (void);
 
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
@@ -25,5 +28,10 @@ void timer_udelay (int64_t microseconds);
 void timer_ndelay (int64_t nanoseconds);
 
 void timer_print_stats (void);
+void timer_idle (void);
+
+/* If true, idle without periodic timer interrupts.
+   Controlled by kernel command-line option "-tickless". */
+extern bool timer_tickless;
 
 #endif /* devices/timer.h */
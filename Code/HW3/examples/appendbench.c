@@ -0,0 +1,70 @@
+/* appendbench.c
+
+   Measures the throughput of growing a file by appending to it,
+   one block at a time, up to 2 MB or until the disk is full.
+   Then reads the file back to check that the blocks landed in
+   order. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define BLOCK_SIZE 4096
+#define MAX_BLOCKS 512
+
+static char buf[BLOCK_SIZE];
+
+int
+main (void) 
+{
+  const char *name = "appendbench.dat";
+  uint64_t start, cycles;
+  unsigned blocks, i;
+  int fd;
+
+  if (!create (name, 0) || (fd = open (name)) < 0)
+    {
+      printf ("%s: create failed\n", name);
+      return EXIT_FAILURE;
+    }
+
+  start = rdtsc ();
+  for (blocks = 0; blocks < MAX_BLOCKS; blocks++)
+    {
+      memset (buf, blocks & 0xff, sizeof buf);
+      if (write (fd, buf, sizeof buf) != sizeof buf)
+        break;
+    }
+  cycles = rdtsc () - start;
+
+  printf ("appended %u bytes in %u writes: %u B/kc\n",
+          blocks * BLOCK_SIZE, blocks,
+          bytes_per_kcycle ((uint64_t) blocks * BLOCK_SIZE, cycles));
+  if (filesize (fd) != (int) (blocks * BLOCK_SIZE))
+    {
+      printf ("%s: file size %d, expected %u\n",
+              name, filesize (fd), blocks * BLOCK_SIZE);
+      return EXIT_FAILURE;
+    }
+
+  seek (fd, 0);
+  start = rdtsc ();
+  for (i = 0; i < blocks; i++)
+    {
+      if (read (fd, buf, sizeof buf) != sizeof buf
+          || buf[0] != (char) (i & 0xff)
+          || buf[BLOCK_SIZE - 1] != (char) (i & 0xff))
+        {
+          printf ("%s: block %u read back wrong\n", name, i);
+          return EXIT_FAILURE;
+        }
+    }
+  cycles = rdtsc () - start;
+  printf ("read back %u bytes: %u B/kc\n", blocks * BLOCK_SIZE,
+          bytes_per_kcycle ((uint64_t) blocks * BLOCK_SIZE, cycles));
+
+  close (fd);
+  remove (name);
+  return EXIT_SUCCESS;
+}
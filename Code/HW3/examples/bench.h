@@ -0,0 +1,29 @@
+/* bench.h
+
+   Helpers shared by the benchmark programs in this directory.
+   User programs have no clock system call, so elapsed time is
+   measured in CPU cycles with the time-stamp counter. */
+
+#ifndef EXAMPLES_BENCH_H
+#define EXAMPLES_BENCH_H
+
+#include <stdint.h>
+
+/* Returns the current value of the time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Returns BYTES per thousand CYCLES, the benchmarks' throughput
+   unit.  Multiply by the CPU clock in MHz to get kB/s. */
+static inline unsigned
+bytes_per_kcycle (uint64_t bytes, uint64_t cycles)
+{
+  return cycles != 0 ? bytes * 1000 / cycles : 0;
+}
+
+#endif /* examples/bench.h */
@@ -0,0 +1,99 @@
+/* dmabench.c
+
+   Measures how well disk reads overlap with computation.  Times
+   reading a file, then a compute loop tuned to take about as
+   long, then both at once in a forked child and the parent.
+   With DMA the reader sleeps while the disk works, so the pair
+   should take little longer than either alone; with the kernel's
+   "-pio" option the CPU copies every sector itself.  The kernel's
+   statistics at power off report the CPU cycles per MB that the
+   disk driver used. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define MAX_SIZE (1024 * 1024)
+#define CHUNK 4096
+
+static char buf[CHUNK];
+static const char *name = "dmabench.dat";
+
+/* Reads the whole file.  Returns the cycles taken. */
+static uint64_t
+read_file (void)
+{
+  uint64_t start = rdtsc ();
+  int fd = open (name);
+
+  if (fd < 0)
+    exit (EXIT_FAILURE);
+  while (read (fd, buf, CHUNK) > 0)
+    continue;
+  close (fd);
+  return rdtsc () - start;
+}
+
+/* Runs ITERS rounds of arithmetic.  Returns the cycles taken. */
+static uint64_t
+compute (unsigned iters)
+{
+  uint64_t start = rdtsc ();
+  volatile unsigned x = 1;
+
+  while (iters-- > 0)
+    x = x * 1103515245 + 12345;
+  return rdtsc () - start;
+}
+
+int
+main (void) 
+{
+  uint64_t t_read, t_comp, t_both, start, shorter;
+  unsigned file_size, iters, done;
+  pid_t pid;
+  int fd;
+
+  for (file_size = MAX_SIZE; file_size >= CHUNK; file_size /= 2)
+    if (create (name, file_size))
+      break;
+  fd = open (name);
+  if (file_size < CHUNK || fd < 0)
+    {
+      printf ("%s: create failed\n", name);
+      return EXIT_FAILURE;
+    }
+  for (done = 0; done < file_size; done += CHUNK)
+    write (fd, buf, CHUNK);
+  close (fd);
+
+  t_read = read_file ();
+  for (iters = 1024; compute (iters) < t_read; iters *= 2)
+    continue;
+  t_comp = compute (iters);
+
+  start = rdtsc ();
+  pid = fork ();
+  if (pid == 0)
+    {
+      compute (iters);
+      exit (EXIT_SUCCESS);
+    }
+  read_file ();
+  if (pid == PID_ERROR || wait (pid) != EXIT_SUCCESS)
+    {
+      printf ("dmabench: fork failed\n");
+      return EXIT_FAILURE;
+    }
+  t_both = rdtsc () - start;
+
+  shorter = t_read < t_comp ? t_read : t_comp;
+  printf ("read:    %llu kcycles per MB\n",
+          t_read * (1024 * 1024 / file_size) / 1000);
+  printf ("compute: %llu kcycles\n", t_comp / 1000);
+  printf ("both:    %llu kcycles\n", t_both / 1000);
+  printf ("overlap: %lld%%\n",
+          (long long) (t_read + t_comp - t_both) * 100 / (long long) shorter);
+  remove (name);
+  return EXIT_SUCCESS;
+}
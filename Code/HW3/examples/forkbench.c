@@ -0,0 +1,69 @@
+/* forkbench.c
+
+   Compares the cost of starting a process with fork against
+   exec.  Each round creates a child that exits at once and waits
+   for it, first ITERS times with fork and then ITERS times with
+   exec of this program.  Run it as
+
+     forkbench [ITERS] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "bench.h"
+
+/* Touched before forking, so the parent has a few pages the
+   child shares copy-on-write. */
+static char data[64 * 1024];
+
+int
+main (int argc, char *argv[]) 
+{
+  uint64_t start, fork_cycles, exec_cycles;
+  int iters = 20, i;
+
+  if (argc == 2 && !strcmp (argv[1], "child"))
+    return EXIT_SUCCESS;
+
+  if (argc > 1)
+    iters = atoi (argv[1]);
+  if (iters < 1)
+    {
+      printf ("forkbench: ITERS must be positive\n");
+      return EXIT_FAILURE;
+    }
+  memset (data, 1, sizeof data);
+
+  start = rdtsc ();
+  for (i = 0; i < iters; i++)
+    {
+      pid_t pid = fork ();
+      if (pid == 0)
+        exit (EXIT_SUCCESS);
+      if (pid == PID_ERROR || wait (pid) != EXIT_SUCCESS)
+        {
+          printf ("forkbench: fork failed\n");
+          return EXIT_FAILURE;
+        }
+    }
+  fork_cycles = rdtsc () - start;
+
+  start = rdtsc ();
+  for (i = 0; i < iters; i++)
+    {
+      pid_t pid = exec ("forkbench child");
+      if (pid == PID_ERROR || wait (pid) != EXIT_SUCCESS)
+        {
+          printf ("forkbench: exec failed\n");
+          return EXIT_FAILURE;
+        }
+    }
+  exec_cycles = rdtsc () - start;
+
+  printf ("fork+exit+wait: %u kcycles each\n",
+          (unsigned) (fork_cycles / iters / 1000));
+  printf ("exec+exit+wait: %u kcycles each\n",
+          (unsigned) (exec_cycles / iters / 1000));
+  return EXIT_SUCCESS;
+}
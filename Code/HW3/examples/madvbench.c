@@ -0,0 +1,93 @@
+/* madvbench.c
+
+   Maps the largest file the file system will give us and, under
+   each kind of madvise() advice, reads one byte of every page, in
+   order and then in a random order.  The mapping's pages are
+   dropped with MADV_DONTNEED before each pass, so every pass reads
+   the file again.  Reports cycles per page, including the time
+   madvise() itself takes. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define MAX_SIZE (1024 * 1024)
+#define PAGE_SIZE 4096
+
+/* Where the file is mapped. */
+static char *const map = (char *) 0x10000000;
+
+static const struct
+  {
+    int advice;
+    const char *name;
+  }
+hints[] =
+  {
+    {MADV_NORMAL, "normal"},
+    {MADV_SEQUENTIAL, "sequential"},
+    {MADV_RANDOM, "random"},
+    {MADV_WILLNEED, "willneed"},
+  };
+
+/* Reads one byte from each of PAGES pages of the mapping, in order
+   if SHUFFLE is false, otherwise in a pseudo-random order, under
+   ADVICE.  Returns the cycles taken. */
+static uint64_t
+scan (mapid_t id, int advice, unsigned pages, bool shuffle)
+{
+  unsigned i, page = 0;
+  uint64_t start;
+
+  madvise (id, MADV_DONTNEED);
+  start = rdtsc ();
+  madvise (id, advice);
+  for (i = 0; i < pages; i++)
+    {
+      /* Adding a stride prime to PAGES visits every page once. */
+      page = shuffle ? (page + 40503) % pages : i;
+      (void) *(volatile char *) (map + page * PAGE_SIZE);
+    }
+  return rdtsc () - start;
+}
+
+int
+main (void) 
+{
+  const char *name = "madvbench.dat";
+  unsigned file_size, pages, i;
+  mapid_t id;
+  int fd;
+
+  for (file_size = MAX_SIZE; file_size >= PAGE_SIZE; file_size /= 2)
+    if (create (name, file_size))
+      break;
+  fd = open (name);
+  if (file_size < PAGE_SIZE || fd < 0)
+    {
+      printf ("%s: create failed\n", name);
+      return EXIT_FAILURE;
+    }
+  pages = file_size / PAGE_SIZE;
+  id = mmap (fd, map);
+  if (id == MAP_FAILED)
+    {
+      printf ("%s: mmap failed\n", name);
+      return EXIT_FAILURE;
+    }
+
+  printf ("%u pages\n", pages);
+  printf ("%12s %12s %12s\n", "advice", "seq c/pg", "random c/pg");
+  for (i = 0; i < sizeof hints / sizeof *hints; i++)
+    {
+      uint64_t seq = scan (id, hints[i].advice, pages, false);
+      uint64_t rnd = scan (id, hints[i].advice, pages, true);
+
+      printf ("%12s %12llu %12llu\n", hints[i].name, seq / pages, rnd / pages);
+    }
+
+  munmap (id);
+  close (fd);
+  remove (name);
+  return EXIT_SUCCESS;
+}
@@ -57,6 +57,11 @@ main (int argc, char *argv[])
       return EXIT_FAILURE;
     }
 
+  /* Both files are used once, front to back, so read ahead and let
+     the pages already copied go first. */
+  madvise (in_map, MADV_SEQUENTIAL);
+  madvise (out_map, MADV_SEQUENTIAL);
+
   /* Copy files. */
   memcpy (out_data, in_data, size);
 
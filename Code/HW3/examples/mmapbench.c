@@ -0,0 +1,81 @@
+/* mmapbench.c
+
+   Maps the largest file the file system will give us, touches
+   every page, and unmaps it again, repeatedly, first only reading
+   the mapping and then writing it.  Reports the cycles spent in
+   mmap(), in faulting the pages in, and in munmap(), which has to
+   find and free every frame of the mapping. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define MAX_SIZE (1024 * 1024)
+#define ROUNDS 8
+#define PAGE_SIZE 4096
+
+/* Where the file is mapped. */
+static char *const map = (char *) 0x10000000;
+
+int
+main (void) 
+{
+  const char *name = "mmapbench.dat";
+  unsigned file_size, pages;
+  int fd, pass;
+
+  for (file_size = MAX_SIZE; file_size >= PAGE_SIZE; file_size /= 2)
+    if (create (name, file_size))
+      break;
+  fd = open (name);
+  if (file_size < PAGE_SIZE || fd < 0)
+    {
+      printf ("%s: create failed\n", name);
+      return EXIT_FAILURE;
+    }
+  pages = file_size / PAGE_SIZE;
+
+  printf ("%u pages, %d rounds\n", pages, ROUNDS);
+  printf ("%6s %12s %12s %12s\n", "access", "mmap c", "fault c/pg", "munmap c/pg");
+  for (pass = 0; pass < 2; pass++)
+    {
+      uint64_t map_cycles = 0, touch_cycles = 0, unmap_cycles = 0;
+      int round;
+
+      for (round = 0; round < ROUNDS; round++)
+        {
+          volatile char *p;
+          uint64_t start;
+          mapid_t id;
+
+          start = rdtsc ();
+          id = mmap (fd, map);
+          map_cycles += rdtsc () - start;
+          if (id == MAP_FAILED)
+            {
+              printf ("%s: mmap failed\n", name);
+              return EXIT_FAILURE;
+            }
+
+          start = rdtsc ();
+          for (p = map; p < map + file_size; p += PAGE_SIZE)
+            if (pass == 0)
+              (void) *p;
+            else
+              *p = round;
+          touch_cycles += rdtsc () - start;
+
+          start = rdtsc ();
+          munmap (id);
+          unmap_cycles += rdtsc () - start;
+        }
+
+      printf ("%6s %12llu %12llu %12llu\n", pass == 0 ? "read" : "write",
+              map_cycles / ROUNDS, touch_cycles / ROUNDS / pages,
+              unmap_cycles / ROUNDS / pages);
+    }
+
+  close (fd);
+  remove (name);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,60 @@
+/* printbench.c
+
+   Measures the cost of console output.  Writes ITERS lines of
+   each of several lengths to the console with write(), and reports
+   the cycles each write() took and the bytes written per thousand
+   cycles.  The 0-byte writes show the cost of the system call
+   alone.  Run it as
+
+     printbench [ITERS]
+
+   The kernel's statistics at power off show whether the serial
+   port's transmit ring had to wait for the port or drop output. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "bench.h"
+
+static const int lengths[] = {0, 1, 16, 80, 512};
+
+int
+main (int argc, char *argv[]) 
+{
+  static char line[512];
+  uint64_t cycles[sizeof lengths / sizeof *lengths];
+  int iters = 100;
+  size_t i;
+  int j;
+
+  if (argc > 1)
+    iters = atoi (argv[1]);
+  if (iters < 1)
+    {
+      printf ("printbench: ITERS must be positive\n");
+      return EXIT_FAILURE;
+    }
+  memset (line, '.', sizeof line);
+
+  for (i = 0; i < sizeof lengths / sizeof *lengths; i++)
+    {
+      int len = lengths[i];
+      uint64_t start;
+
+      if (len > 0)
+        line[len - 1] = '\n';
+      start = rdtsc ();
+      for (j = 0; j < iters; j++)
+        write (STDOUT_FILENO, line, len);
+      cycles[i] = rdtsc () - start;
+      if (len > 0)
+        line[len - 1] = '.';
+    }
+
+  printf ("%8s %12s %12s\n", "bytes", "cycles", "B/kcycle");
+  for (i = 0; i < sizeof lengths / sizeof *lengths; i++)
+    printf ("%8d %12llu %12u\n", lengths[i], cycles[i] / iters,
+            bytes_per_kcycle ((uint64_t) lengths[i] * iters, cycles[i]));
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,69 @@
+/* rwbench.c
+
+   Measures read() and write() throughput for buffer sizes from
+   1 byte to 1 MB, to show the cost of validating user buffers
+   in the system call layer.  Each size is repeated until about
+   1 MB has been transferred. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define MAX_SIZE (1024 * 1024)
+#define TOTAL (1024 * 1024)
+
+static char buf[MAX_SIZE];
+
+int
+main (void) 
+{
+  const char *name = "rwbench.dat";
+  unsigned file_size, size;
+  int fd;
+
+  /* Use the largest file the file system will give us. */
+  for (file_size = MAX_SIZE; file_size > 0; file_size /= 2)
+    if (create (name, file_size))
+      break;
+  fd = open (name);
+  if (file_size == 0 || fd < 0)
+    {
+      printf ("%s: create failed\n", name);
+      return EXIT_FAILURE;
+    }
+
+  printf ("%8s %8s %12s %12s\n", "size", "calls", "write B/kc", "read B/kc");
+  for (size = 1; size <= file_size; size *= 4)
+    {
+      unsigned calls = size < TOTAL ? TOTAL / size : 1;
+      uint64_t start, write_cycles, read_cycles;
+      unsigned i;
+
+      if (calls > 4096)
+        calls = 4096;
+
+      start = rdtsc ();
+      for (i = 0; i < calls; i++)
+        {
+          seek (fd, 0);
+          write (fd, buf, size);
+        }
+      write_cycles = rdtsc () - start;
+
+      start = rdtsc ();
+      for (i = 0; i < calls; i++)
+        {
+          seek (fd, 0);
+          read (fd, buf, size);
+        }
+      read_cycles = rdtsc () - start;
+
+      printf ("%8u %8u %12u %12u\n", size, calls,
+              bytes_per_kcycle ((uint64_t) size * calls, write_cycles),
+              bytes_per_kcycle ((uint64_t) size * calls, read_cycles));
+    }
+
+  close (fd);
+  remove (name);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+/* spawnbench.c
+
+   Starts N copies of a program at once and waits for them all,
+   timing the whole batch.  By default the copies are this program
+   itself, which just spins for a while so that they all stay alive
+   together.  Run it as
+
+     spawnbench [N [PROGRAM]]
+
+   The kernel's frame statistics, printed at power off, show how
+   many text pages were read from disk and how many were shared. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define MAX_CHILDREN 32
+
+int
+main (int argc, char *argv[]) 
+{
+  pid_t children[MAX_CHILDREN];
+  const char *prog = "spawnbench child";
+  uint64_t start, cycles;
+  int n = 8, i;
+
+  if (argc == 2 && !strcmp (argv[1], "child"))
+    {
+      volatile unsigned spin;
+      for (spin = 0; spin < 5000000; spin++)
+        continue;
+      return EXIT_SUCCESS;
+    }
+
+  if (argc > 1)
+    n = atoi (argv[1]);
+  if (argc > 2)
+    prog = argv[2];
+  if (n < 1 || n > MAX_CHILDREN)
+    {
+      printf ("spawnbench: N must be between 1 and %d\n", MAX_CHILDREN);
+      return EXIT_FAILURE;
+    }
+
+  start = rdtsc ();
+  for (i = 0; i < n; i++)
+    {
+      children[i] = exec (prog);
+      if (children[i] == PID_ERROR)
+        {
+          printf ("spawnbench: exec \"%s\" failed\n", prog);
+          return EXIT_FAILURE;
+        }
+    }
+  for (i = 0; i < n; i++)
+    wait (children[i]);
+  cycles = rdtsc () - start;
+
+  printf ("ran %d copies of \"%s\" in %u kcycles\n",
+          n, prog, (unsigned) (cycles / 1000));
+  return EXIT_SUCCESS;
+}
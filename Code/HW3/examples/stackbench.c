@@ -0,0 +1,47 @@
+/* stackbench.c
+
+   Recurses deeper and deeper, 256 bytes of stack per call, and
+   reports the cycles per call of the first descent to each depth,
+   which has to grow the stack, and of a second descent over the
+   same pages, which does not. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define FRAME_SIZE 240
+#define MAX_DEPTH 16384
+
+static int
+recurse (int n)
+{
+  volatile char pad[FRAME_SIZE];
+
+  memset ((char *) pad, n, sizeof pad);
+  return (n > 0 ? recurse (n - 1) : 0) + pad[0];
+}
+
+static uint64_t
+descend (int depth)
+{
+  uint64_t start = rdtsc ();
+  recurse (depth);
+  return rdtsc () - start;
+}
+
+int
+main (void) 
+{
+  int depth;
+
+  printf ("%8s %14s %14s\n", "depth", "grow c/call", "reuse c/call");
+  for (depth = 64; depth <= MAX_DEPTH; depth *= 4)
+    {
+      uint64_t grow = descend (depth);
+      uint64_t reuse = descend (depth);
+
+      printf ("%8d %14llu %14llu\n", depth, grow / depth, reuse / depth);
+    }
+  return EXIT_SUCCESS;
+}
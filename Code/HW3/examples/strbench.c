@@ -0,0 +1,75 @@
+/* strbench.c
+
+   Measures the cost of system calls that take a string
+   argument: open() and create() on file names, and exec() on a
+   command line naming a missing program.  Reports TSC cycles per
+   call, which is dominated by copying and checking the string
+   when the file system work is trivial. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define ITERATIONS 256
+
+/* Runs ITERATIONS calls of syscall NAME with string argument
+   STR and prints the average cost. */
+static void
+measure (const char *name, int (*call) (const char *), const char *str)
+{
+  uint64_t start, cycles;
+  int i;
+
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    call (str);
+  cycles = rdtsc () - start;
+
+  printf ("%-8s %4zu-byte arg: %8llu cycles/call\n",
+          name, strlen (str), cycles / ITERATIONS);
+}
+
+static int
+do_open (const char *name)
+{
+  int fd = open (name);
+  if (fd >= 0)
+    close (fd);
+  return fd;
+}
+
+static int
+do_create (const char *name)
+{
+  return create (name, 0);
+}
+
+static int
+do_exec (const char *cmd_line)
+{
+  return exec (cmd_line);
+}
+
+int
+main (void) 
+{
+  static char long_arg[512];
+
+  memset (long_arg, 'x', sizeof long_arg - 1);
+
+  if (!create ("strbench", 0))
+    {
+      printf ("strbench: create failed\n");
+      return EXIT_FAILURE;
+    }
+  measure ("open", do_open, "strbench");
+  measure ("open", do_open, "no-such-file");
+  measure ("create", do_create, "strbench");
+  measure ("create", do_create, long_arg);
+  measure ("exec", do_exec, "no-such-program");
+  measure ("exec", do_exec, long_arg);
+  remove ("strbench");
+
+  return EXIT_SUCCESS;
+}
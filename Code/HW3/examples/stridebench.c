@@ -0,0 +1,46 @@
+/* stridebench.c
+
+   Reads one byte at each of a range of strides across an 8 MB
+   array and reports the cycles per access, which climb once the
+   stride is large enough that every access needs its own TLB
+   entry.  The first pass over the array faults its pages in and
+   is not timed. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define ARRAY_SIZE (8 * 1024 * 1024)
+#define ACCESSES 65536
+
+static char array[ARRAY_SIZE];
+
+/* Reads ACCESSES bytes STRIDE bytes apart, wrapping around the end
+   of the array.  Returns the cycles taken. */
+static uint64_t
+walk (unsigned stride)
+{
+  unsigned i, ofs = 0;
+  uint64_t start = rdtsc ();
+
+  for (i = 0; i < ACCESSES; i++)
+    {
+      (void) *(volatile char *) (array + ofs);
+      ofs = (ofs + stride) % ARRAY_SIZE;
+      if (stride >= ARRAY_SIZE / ACCESSES && ofs < stride)
+        ofs = (ofs + 64) % stride;
+    }
+  return rdtsc () - start;
+}
+
+int
+main (void) 
+{
+  unsigned stride;
+
+  walk (4096);
+  printf ("%12s %12s\n", "stride", "c/access");
+  for (stride = 64; stride <= 4 * 1024 * 1024; stride *= 2)
+    printf ("%12u %12llu\n", stride, walk (stride) / ACCESSES);
+  return EXIT_SUCCESS;
+}
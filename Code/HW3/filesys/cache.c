@@ -0,0 +1,427 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* How often the flusher thread writes back dirty sectors. */
+#define FLUSH_INTERVAL_MS 1000
+
+/* Maximum number of queued read-ahead requests. */
+#define READ_AHEAD_MAX 16
+
+/* A cached sector. */
+struct cache_entry
+  {
+    block_sector_t sector;              /* Sector held, if in use. */
+    bool in_use;                        /* Assigned to a sector? */
+    bool valid;                         /* Data read from disk? */
+    bool dirty;                         /* Data newer than disk? */
+    bool accessed;                      /* Used since the clock hand
+                                           last passed? */
+    int users;                          /* Threads using this entry;
+                                           never evicted while > 0. */
+    bool prefetched;                    /* Read ahead and not used
+                                           since? */
+    bool writing_back;                  /* Old contents being written
+                                           to OLD_SECTOR? */
+    block_sector_t old_sector;          /* Sector held before eviction. */
+    struct lock lock;                   /* Protects the data below. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+
+/* Protects sector, in_use, accessed, users, prefetched,
+   writing_back and old_sector of every entry, and the clock
+   hand. */
+static struct lock cache_lock;
+static size_t clock_hand;
+
+/* Signalled, with cache_lock, when an evicted entry's old
+   contents reach the disk. */
+static struct condition write_back_done;
+
+/* Signalled, with cache_lock, when an entry's users drop to 0,
+   so that it can be evicted. */
+static struct condition entry_released;
+
+/* Read-ahead requests, consumed by the read-ahead thread. */
+static block_sector_t read_ahead_queue[READ_AHEAD_MAX];
+static size_t read_ahead_head, read_ahead_cnt;
+static struct lock read_ahead_lock;
+static struct semaphore read_ahead_sema;
+
+/* Copies of the sectors that cache_flush() is writing back, with
+   their block requests and entries.  Protected by flush_lock. */
+static uint8_t *flush_buf;
+static struct block_request flush_req[CACHE_SIZE];
+static struct cache_entry *flush_entry[CACHE_SIZE];
+static struct lock flush_lock;
+
+/* Statistics.  Hits and misses count demand accesses only.  A
+   sector brought in by read-ahead counts as a read-ahead, and the
+   first demand access to it as a read-ahead hit. */
+static long long hit_cnt, miss_cnt, write_back_cnt;
+static long long read_ahead_cnt_total, read_ahead_hit_cnt;
+
+static thread_func flusher_thread NO_RETURN;
+static thread_func read_ahead_thread NO_RETURN;
+
+/* Initializes the buffer cache and starts its flusher and
+   read-ahead threads. */
+void
+cache_init (void) 
+{
+  size_t i;
+
+  lock_init (&cache_lock);
+  cond_init (&write_back_done);
+  cond_init (&entry_released);
+  for (i = 0; i < CACHE_SIZE; i++)
+    lock_init (&cache[i].lock);
+
+  lock_init (&read_ahead_lock);
+  sema_init (&read_ahead_sema, 0);
+
+  lock_init (&flush_lock);
+  flush_buf = palloc_get_multiple (PAL_ASSERT,
+                                   CACHE_SIZE * BLOCK_SECTOR_SIZE / PGSIZE);
+
+  thread_create ("cache-flush", PRI_DEFAULT, flusher_thread, NULL);
+  thread_create ("cache-ahead", PRI_DEFAULT, read_ahead_thread, NULL);
+}
+
+/* Returns true if SECTOR's old contents are being written back
+   by an eviction.  cache_lock must be held. */
+static bool
+writing_back (block_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].writing_back && cache[i].old_sector == sector)
+      return true;
+  return false;
+}
+
+/* Chooses an entry to evict with the clock algorithm, skipping
+   entries in use.  Returns a null pointer if every entry is in
+   use.  cache_lock must be held. */
+static struct cache_entry *
+choose_victim (void)
+{
+  size_t i;
+
+  for (i = 0; i < 2 * CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+      if (!e->in_use)
+        return e;
+      if (e->users > 0)
+        continue;
+      if (e->accessed)
+        e->accessed = false;
+      else
+        return e;
+    }
+  return NULL;
+}
+
+/* Returns the entry for SECTOR with its lock held, loading it
+   from disk unless WILL_OVERWRITE is true, in which case the
+   caller is about to replace the whole sector.  AHEAD is true for
+   a read-ahead rather than a demand access. */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool will_overwrite, bool ahead)
+{
+  struct cache_entry *e = NULL;
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      for (i = 0; i < CACHE_SIZE; i++)
+        if (cache[i].in_use && cache[i].sector == sector)
+          {
+            e = &cache[i];
+            if (ahead)
+              ;
+            else if (e->prefetched)
+              {
+                e->prefetched = false;
+                read_ahead_hit_cnt++;
+              }
+            else
+              hit_cnt++;
+            break;
+          }
+      if (e != NULL)
+        break;
+
+      /* An eviction is still writing SECTOR out.  Reading it now
+         would fetch a stale copy from disk. */
+      if (writing_back (sector))
+        {
+          cond_wait (&write_back_done, &cache_lock);
+          continue;
+        }
+
+      e = choose_victim ();
+      if (e != NULL)
+        {
+          /* No other thread uses E, so its lock is free.  Give it
+             to SECTOR at once, so that other misses on SECTOR
+             wait on its lock, and write back the old sector
+             without cache_lock.  Misses on the old sector wait
+             for that write, see above. */
+          bool dirty;
+
+          lock_acquire (&e->lock);
+          dirty = e->in_use && e->valid && e->dirty;
+          e->writing_back = dirty;
+          e->old_sector = e->sector;
+          e->sector = sector;
+          e->in_use = true;
+          e->valid = false;
+          e->dirty = false;
+          e->users++;
+          e->accessed = true;
+          e->prefetched = ahead;
+          if (ahead)
+            read_ahead_cnt_total++;
+          else
+            miss_cnt++;
+          lock_release (&cache_lock);
+
+          if (dirty)
+            {
+              block_write (fs_device, e->old_sector, e->data);
+              lock_acquire (&cache_lock);
+              e->writing_back = false;
+              write_back_cnt++;
+              cond_broadcast (&write_back_done, &cache_lock);
+              lock_release (&cache_lock);
+            }
+          goto loaded;
+        }
+
+      /* Every entry is busy.  Wait for one to be released. */
+      cond_wait (&entry_released, &cache_lock);
+    }
+  e->users++;
+  e->accessed = true;
+  lock_release (&cache_lock);
+  lock_acquire (&e->lock);
+
+ loaded:
+  if (!e->valid && !will_overwrite)
+    {
+      block_read (fs_device, sector, e->data);
+      e->valid = true;
+    }
+  return e;
+}
+
+/* Releases E, obtained from cache_get(). */
+static void
+cache_put (struct cache_entry *e)
+{
+  lock_release (&e->lock);
+  lock_acquire (&cache_lock);
+  if (--e->users == 0)
+    cond_broadcast (&entry_released, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Reads SIZE bytes at offset OFS within SECTOR into BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer, size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, false, false);
+  memcpy (buffer, e->data + ofs, size);
+  cache_put (e);
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS within SECTOR.
+   The sector reaches the disk when it is evicted or flushed. */
+void
+cache_write_at (block_sector_t sector, const void *buffer,
+                size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, size == BLOCK_SECTOR_SIZE, false);
+  memcpy (e->data + ofs, buffer, size);
+  e->valid = true;
+  e->dirty = true;
+  cache_put (e);
+}
+
+/* Asks the read-ahead thread to bring SECTOR into the cache.
+   Does not wait; the request is dropped if the queue is full. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  bool queued = false;
+
+  lock_acquire (&read_ahead_lock);
+  if (read_ahead_cnt < READ_AHEAD_MAX)
+    {
+      read_ahead_queue[(read_ahead_head + read_ahead_cnt) % READ_AHEAD_MAX]
+        = sector;
+      read_ahead_cnt++;
+      queued = true;
+    }
+  lock_release (&read_ahead_lock);
+
+  if (queued)
+    sema_up (&read_ahead_sema);
+}
+
+/* Drops the cached copy of SECTOR, if there is one, without
+   writing it back, so that SECTOR is next read from disk.  For a
+   sector just allocated, whose old contents no longer matter and
+   which the caller writes to disk directly.  Waits for a write of
+   the old contents already under way, so that it cannot land
+   after the caller's. */
+void
+cache_discard (block_sector_t sector)
+{
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  while (writing_back (sector))
+    cond_wait (&write_back_done, &cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+
+      if (e->in_use && e->sector == sector)
+        {
+          e->users++;
+          lock_release (&cache_lock);
+
+          lock_acquire (&e->lock);
+          e->valid = false;
+          e->dirty = false;
+          cache_put (e);
+          return;
+        }
+    }
+  lock_release (&cache_lock);
+}
+
+/* Writes every dirty sector back to disk.
+
+   The dirty sectors are copied out and submitted all at once, so
+   that the disk's scheduler can sort and merge the writes.  Each
+   entry is unlocked once copied but stays in use until its write
+   completes, so that it cannot be evicted and then read back from
+   disk before the new contents arrive there. */
+void
+cache_flush (void)
+{
+  size_t i, cnt = 0;
+
+  lock_acquire (&flush_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+
+      /* Keep E from being evicted while we wait for its lock. */
+      lock_acquire (&cache_lock);
+      if (!e->in_use)
+        {
+          lock_release (&cache_lock);
+          continue;
+        }
+      e->users++;
+      lock_release (&cache_lock);
+
+      lock_acquire (&e->lock);
+      if (!e->valid || !e->dirty)
+        {
+          cache_put (e);
+          continue;
+        }
+      memcpy (flush_buf + cnt * BLOCK_SECTOR_SIZE, e->data,
+              BLOCK_SECTOR_SIZE);
+      e->dirty = false;
+      write_back_cnt++;
+
+      /* Queue the write before unlocking E, so that a write of
+         the same sector made after cache_discard() is queued
+         behind it. */
+      block_request_init (&flush_req[cnt], e->sector, 1,
+                          flush_buf + cnt * BLOCK_SECTOR_SIZE, true);
+      block_submit (fs_device, &flush_req[cnt]);
+      lock_release (&e->lock);
+      flush_entry[cnt++] = e;
+    }
+
+  for (i = 0; i < cnt; i++)
+    {
+      block_wait (&flush_req[i]);
+      lock_acquire (&cache_lock);
+      if (--flush_entry[i]->users == 0)
+        cond_broadcast (&entry_released, &cache_lock);
+      lock_release (&cache_lock);
+    }
+  lock_release (&flush_lock);
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void) 
+{
+  printf ("Cache: %lld hits, %lld misses, %lld read-aheads "
+          "(%lld used), %lld write-backs\n",
+          hit_cnt, miss_cnt, read_ahead_cnt_total, read_ahead_hit_cnt,
+          write_back_cnt);
+}
+
+/* Periodically writes dirty sectors back to disk, so that a
+   crash loses at most FLUSH_INTERVAL_MS worth of writes. */
+static void
+flusher_thread (void *aux UNUSED) 
+{
+  for (;;)
+    {
+      timer_msleep (FLUSH_INTERVAL_MS);
+      cache_flush ();
+    }
+}
+
+/* Brings sectors queued by cache_read_ahead() into the cache. */
+static void
+read_ahead_thread (void *aux UNUSED) 
+{
+  for (;;)
+    {
+      block_sector_t sector;
+
+      sema_down (&read_ahead_sema);
+      lock_acquire (&read_ahead_lock);
+      sector = read_ahead_queue[read_ahead_head];
+      read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_MAX;
+      read_ahead_cnt--;
+      lock_release (&read_ahead_lock);
+
+      cache_put (cache_get (sector, false, true));
+    }
+}
@@ -3,21 +3,38 @@
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Number of sector pointers held in the inode itself, and in
+   one index sector. */
+#define DIRECT_CNT 124
+#define INDIRECT_CNT (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* Largest file, in sectors. */
+#define MAX_SECTORS (DIRECT_CNT + INDIRECT_CNT \
+                     + INDIRECT_CNT * INDIRECT_CNT)
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+   A sector pointer of 0 means the sector is not allocated, and
+   reads of it return zeros.  (Sector 0 holds the free map inode,
+   so it is never a data or index sector.) */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
+    block_sector_t direct[DIRECT_CNT];  /* Data sectors. */
+    block_sector_t indirect;            /* Sector of data sector
+                                           pointers. */
+    block_sector_t double_indirect;     /* Sector of indirect sector
+                                           pointers. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -28,6 +45,13 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
+/* In-memory copy of one index sector. */
+struct index_copy
+  {
+    block_sector_t sector;              /* Index sector, 0 if none. */
+    block_sector_t ptrs[INDIRECT_CNT];  /* Its contents. */
+  };
+
 /* In-memory inode. */
 struct inode 
   {
@@ -36,32 +60,220 @@ struct inode
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct rwlock rw;                   /* Readers-writer lock for data. */
+    off_t next_read;                    /* Offset just past the last read,
+                                           to detect sequential access. */
     struct inode_disk data;             /* Inode content. */
+
+    /* Index sectors last used by byte_to_sector(), so that
+       sequential access past the direct sectors does not go
+       through the buffer cache for every sector.  Writers holding
+       RW invalidate them; readers share RW, so INDEX_LOCK
+       serializes their use. */
+    struct lock index_lock;
+    struct index_copy leaf;             /* Sector of data pointers. */
+    struct index_copy top;              /* Doubly indirect sector. */
   };
 
+/* Returns the pointer in slot IDX of index sector BLOCK, or 0
+   if BLOCK is 0. */
+static block_sector_t
+index_get (block_sector_t block, size_t idx)
+{
+  block_sector_t sector = 0;
+
+  if (block != 0)
+    cache_read_at (block, &sector, idx * sizeof sector, sizeof sector);
+  return sector;
+}
+
+/* Returns the pointer in slot IDX of index sector BLOCK, or 0
+   if BLOCK is 0, reading BLOCK into COPY unless it is already
+   there. */
+static block_sector_t
+index_copy_get (struct index_copy *copy, block_sector_t block, size_t idx)
+{
+  if (block == 0)
+    return 0;
+  if (copy->sector != block)
+    {
+      cache_read_at (block, copy->ptrs, 0, BLOCK_SECTOR_SIZE);
+      copy->sector = block;
+    }
+  return copy->ptrs[idx];
+}
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   within INODE.  The caller must hold INODE->rw.
+   Returns 0 if no sector has been allocated for POS. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos) 
 {
-  ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+  const struct inode_disk *disk = &inode->data;
+  size_t idx = pos / BLOCK_SECTOR_SIZE;
+  block_sector_t sector = 0;
+
+  if (idx < DIRECT_CNT)
+    return disk->direct[idx];
+  idx -= DIRECT_CNT;
+  lock_acquire (&inode->index_lock);
+  if (idx < INDIRECT_CNT)
+    sector = index_copy_get (&inode->leaf, disk->indirect, idx);
   else
-    return -1;
+    {
+      idx -= INDIRECT_CNT;
+      if (idx < INDIRECT_CNT * INDIRECT_CNT)
+        {
+          block_sector_t block = index_copy_get (&inode->top,
+                                                 disk->double_indirect,
+                                                 idx / INDIRECT_CNT);
+          sector = index_copy_get (&inode->leaf, block, idx % INDIRECT_CNT);
+        }
+    }
+  lock_release (&inode->index_lock);
+  return sector;
+}
+
+/* Most sectors zero_sectors() writes with one request. */
+#define ZERO_RUN_MAX 16
+
+/* ZERO_RUN_MAX sectors of zeros. */
+static char zeros[ZERO_RUN_MAX * BLOCK_SECTOR_SIZE];
+
+/* Allocates a sector and stores it in *SECTORP, unless *SECTORP
+   is already allocated.  The new sector is zeroed through the
+   buffer cache if ZERO is true; otherwise the caller must fill
+   it.
+   Returns false if the disk is full. */
+static bool
+allocate_sector (block_sector_t *sectorp, bool zero)
+{
+  if (*sectorp != 0)
+    return true;
+  if (!free_map_allocate (1, sectorp))
+    return false;
+  if (zero)
+    cache_write_at (*sectorp, zeros, 0, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Returns the pointer in slot IDX of index sector BLOCK,
+   allocating a sector for the slot if it is empty, zeroed if
+   ZERO is true.
+   Returns 0 if the disk is full. */
+static block_sector_t
+index_allocate (block_sector_t block, size_t idx, bool zero)
+{
+  block_sector_t sector = index_get (block, idx);
+
+  if (sector == 0 && allocate_sector (&sector, zero))
+    cache_write_at (block, &sector, idx * sizeof sector, sizeof sector);
+  return sector;
+}
+
+/* Like byte_to_sector(), but allocates the data sector for POS,
+   and any index sectors needed to reach it, if they do not exist
+   yet.  Index sectors are always zeroed; a new data sector only
+   if ZERO_DATA is true.  Changes to DISK itself are left for the
+   caller to write back.
+   Returns 0 if the disk is full or POS is past the largest
+   possible file. */
+static block_sector_t
+byte_to_sector_allocate (struct inode_disk *disk, off_t pos, bool zero_data)
+{
+  size_t idx = pos / BLOCK_SECTOR_SIZE;
+
+  if (idx < DIRECT_CNT)
+    return (allocate_sector (&disk->direct[idx], zero_data)
+            ? disk->direct[idx] : 0);
+  idx -= DIRECT_CNT;
+  if (idx < INDIRECT_CNT)
+    return (allocate_sector (&disk->indirect, true)
+            ? index_allocate (disk->indirect, idx, zero_data) : 0);
+  idx -= INDIRECT_CNT;
+  if (idx < INDIRECT_CNT * INDIRECT_CNT)
+    {
+      block_sector_t block;
+
+      if (!allocate_sector (&disk->double_indirect, true))
+        return 0;
+      block = index_allocate (disk->double_indirect, idx / INDIRECT_CNT,
+                              true);
+      return (block != 0
+              ? index_allocate (block, idx % INDIRECT_CNT, zero_data) : 0);
+    }
+  return 0;
+}
+
+/* Writes zeros to the CNT sectors starting at SECTOR, which were
+   just allocated, with one block request, bypassing the buffer
+   cache.  A cached copy of one of them, left over from the file
+   that last used it, would hide the zeros or, if dirty, overwrite
+   them, so it is dropped both before the write and after it, in
+   case read-ahead brought it back meanwhile. */
+static void
+zero_sectors (block_sector_t sector, size_t cnt)
+{
+  size_t i;
+
+  ASSERT (cnt <= ZERO_RUN_MAX);
+
+  for (i = 0; i < cnt; i++)
+    cache_discard (sector + i);
+  block_write_multiple (fs_device, sector, cnt, zeros);
+  for (i = 0; i < cnt; i++)
+    cache_discard (sector + i);
+}
+
+/* Releases index sector BLOCK and everything it points to.
+   LEVEL is 1 for an indirect sector, 2 for a doubly indirect
+   one. */
+static void
+release_index (block_sector_t block, int level)
+{
+  block_sector_t sectors[INDIRECT_CNT];
+  size_t i;
+
+  if (block == 0)
+    return;
+  cache_read_at (block, sectors, 0, BLOCK_SECTOR_SIZE);
+  for (i = 0; i < INDIRECT_CNT; i++)
+    if (sectors[i] != 0)
+      {
+        if (level > 1)
+          release_index (sectors[i], level - 1);
+        else
+          free_map_release (sectors[i], 1);
+      }
+  free_map_release (block, 1);
+}
+
+/* Releases every data and index sector of DISK. */
+static void
+release_sectors (struct inode_disk *disk)
+{
+  size_t i;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    if (disk->direct[i] != 0)
+      free_map_release (disk->direct[i], 1);
+  release_index (disk->indirect, 1);
+  release_index (disk->double_indirect, 2);
 }
 
 /* List of open inodes, so that opening a single inode twice
    returns the same `struct inode'. */
 static struct list open_inodes;
 
+/* Protects open_inodes and the open_cnt of every inode on it. */
+static struct lock open_inodes_lock;
+
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
   list_init (&open_inodes);
+  lock_init (&open_inodes_lock);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -85,21 +297,44 @@ inode_create (block_sector_t sector, off_t length)
   if (disk_inode != NULL)
     {
       size_t sectors = bytes_to_sectors (length);
+      block_sector_t run_start = 0;
+      size_t run_cnt = 0;
+      size_t i;
+
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+
+      /* Allocate the initial sectors up front, so that creating
+         a file fails if the disk cannot hold it.  Later growth is
+         allocated as it is written.  The data sectors are
+         zeroed in runs of consecutive sectors, a block request
+         per run, rather than one cache write each. */
+      success = sectors <= MAX_SECTORS;
+      for (i = 0; success && i < sectors; i++)
         {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
+          block_sector_t data = byte_to_sector_allocate (disk_inode,
+                                                         i * BLOCK_SECTOR_SIZE,
+                                                         false);
+          if (data == 0)
+            success = false;
+          else if (run_cnt > 0 && data == run_start + run_cnt
+                   && run_cnt < ZERO_RUN_MAX)
+            run_cnt++;
+          else
             {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
+              if (run_cnt > 0)
+                zero_sectors (run_start, run_cnt);
+              run_start = data;
+              run_cnt = 1;
             }
-          success = true; 
-        } 
+        }
+      if (success && run_cnt > 0)
+        zero_sectors (run_start, run_cnt);
+
+      if (success)
+        cache_write_at (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+      else
+        release_sectors (disk_inode);
       free (disk_inode);
     }
   return success;
@@ -114,6 +349,8 @@ inode_open (block_sector_t sector)
   struct list_elem *e;
   struct inode *inode;
 
+  lock_acquire (&open_inodes_lock);
+
   /* Check whether this inode is already open. */
   for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
        e = list_next (e)) 
@@ -121,7 +358,8 @@ inode_open (block_sector_t sector)
       inode = list_entry (e, struct inode, elem);
       if (inode->sector == sector) 
         {
-          inode_reopen (inode);
+          inode->open_cnt++;
+          lock_release (&open_inodes_lock);
           return inode; 
         }
     }
@@ -129,15 +367,27 @@ inode_open (block_sector_t sector)
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
+  /* Initialize.  Other openers block on the write lock until the
+     inode has been read in. */
   list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->next_read = 0;
+  rw_init (&inode->rw);
+  lock_init (&inode->index_lock);
+  inode->leaf.sector = inode->top.sector = 0;
+  rw_write_acquire (&inode->rw);
+  lock_release (&open_inodes_lock);
+
+  cache_read_at (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  rw_write_release (&inode->rw);
   return inode;
 }
 
@@ -146,7 +396,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -168,21 +422,24 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
+  lock_acquire (&open_inodes_lock);
   if (--inode->open_cnt == 0)
     {
       /* Remove from inode list and release lock. */
       list_remove (&inode->elem);
+      lock_release (&open_inodes_lock);
  
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          release_sectors (&inode->data);
         }
 
       free (inode); 
     }
+  else
+    lock_release (&open_inodes_lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -202,8 +459,10 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+  bool sequential;
 
+  rw_read_acquire (&inode->rw);
+  sequential = offset == inode->next_read;
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
@@ -220,50 +479,53 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      /* Holes in a sparse file read as zeros. */
+      if (sector_idx != 0)
+        cache_read_at (sector_idx, buffer + bytes_read,
+                       sector_ofs, chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+
+  /* A reader going through the file in order will want the next
+     sector soon, so start fetching it now. */
+  if (sequential && bytes_read > 0 && offset < inode_length (inode))
+    {
+      block_sector_t next = byte_to_sector (inode, offset);
+      if (next != 0)
+        cache_read_ahead (next);
+    }
+  inode->next_read = offset;
+  rw_read_release (&inode->rw);
 
   return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up or an error occurs.
+   Writing past end of file extends the inode.  Sectors are
+   allocated only as they are written, so skipping ahead with a
+   seek leaves a hole that reads as zeros. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  bool disk_changed = false;
 
+  rw_write_acquire (&inode->rw);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      rw_write_release (&inode->rw);
+      return 0;
+    }
 
   while (size > 0) 
     {
@@ -271,48 +533,38 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       block_sector_t sector_idx = byte_to_sector (inode, offset);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
-
       /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
-        break;
+      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      int chunk_size = size < sector_left ? size : sector_left;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      if (sector_idx == 0)
         {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
+          /* Allocation may fill in slots of the cached index
+             sectors. */
+          inode->leaf.sector = inode->top.sector = 0;
+          sector_idx = byte_to_sector_allocate (&inode->data, offset, true);
+          disk_changed = true;
+          if (sector_idx == 0)
+            break;
         }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
 
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      cache_write_at (sector_idx, buffer + bytes_written,
+                      sector_ofs, chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  if (offset > inode->data.length)
+    {
+      inode->data.length = offset;
+      disk_changed = true;
+    }
+  if (disk_changed)
+    cache_write_at (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  rw_write_release (&inode->rw);
 
   return bytes_written;
 }
@@ -322,8 +574,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  rw_write_acquire (&inode->rw);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rw_write_release (&inode->rw);
 }
 
 /* Re-enables writes to INODE.
@@ -332,9 +586,11 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rw_write_acquire (&inode->rw);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rw_write_release (&inode->rw);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -28,7 +28,22 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_FORK,                   /* Copy this process. */
+    SYS_MSYNC,                  /* Write back a memory mapping. */
+    SYS_MADVISE                 /* Give advice on a memory mapping. */
+  };
+
+/* Advice for madvise(). */
+enum
+  {
+    MADV_NORMAL,                /* No special treatment. */
+    MADV_SEQUENTIAL,            /* Read ahead; drop pages behind. */
+    MADV_RANDOM,                /* No read-ahead. */
+    MADV_WILLNEED,              /* Read in the whole mapping now. */
+    MADV_DONTNEED               /* Write back and drop the mapping's pages. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -0,0 +1,54 @@
+/* Child process for syn-thru test.
+   Repeatedly writes its own file a block at a time and reads it
+   back, checking the contents. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/base/syn-thru.h"
+
+const char *test_name = "child-syn-thru";
+
+static char buf[FILE_SIZE];
+static char block[BLOCK_SIZE];
+
+int
+main (int argc, const char *argv[]) 
+{
+  char file_name[16];
+  int child_idx;
+  int pass;
+  int fd;
+  size_t ofs;
+
+  quiet = true;
+  
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+  snprintf (file_name, sizeof file_name, "thru%d", child_idx);
+
+  random_init (child_idx);
+  random_bytes (buf, sizeof buf);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (pass = 0; pass < PASS_CNT; pass++)
+    {
+      seek (fd, 0);
+      for (ofs = 0; ofs < FILE_SIZE; ofs += BLOCK_SIZE)
+        CHECK (write (fd, buf + ofs, BLOCK_SIZE) == BLOCK_SIZE,
+               "write \"%s\"", file_name);
+
+      seek (fd, 0);
+      for (ofs = 0; ofs < FILE_SIZE; ofs += BLOCK_SIZE)
+        {
+          CHECK (read (fd, block, BLOCK_SIZE) == BLOCK_SIZE,
+                 "read \"%s\"", file_name);
+          compare_bytes (block, buf + ofs, BLOCK_SIZE, ofs, file_name);
+        }
+    }
+  close (fd);
+
+  return child_idx;
+}
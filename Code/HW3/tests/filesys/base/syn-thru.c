@@ -0,0 +1,42 @@
+/* Spawns several child processes, each of which writes and reads
+   back its own file, and reports the aggregate throughput.  The
+   children work on unrelated files, so they should not have to
+   wait for each other's disk I/O. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/base/syn-thru.h"
+
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  uint64_t start, cycles;
+  size_t i;
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      char file_name[16];
+      snprintf (file_name, sizeof file_name, "thru%zu", i);
+      CHECK (create (file_name, FILE_SIZE), "create \"%s\"", file_name);
+    }
+
+  start = rdtsc ();
+  exec_children ("child-syn-thru", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+  cycles = rdtsc () - start;
+
+  msg ("aggregate throughput: %llu bytes/Mcycle",
+       cycles ? (uint64_t) TOTAL_BYTES * 1000000 / cycles : 0);
+}
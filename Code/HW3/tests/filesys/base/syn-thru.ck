@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The throughput figure varies from run to run.
+@output = grep (!/^\(syn-thru\) aggregate throughput: \d+ bytes\/Mcycle$/,
+                @output);
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(syn-thru) begin
+(syn-thru) create "thru0"
+(syn-thru) create "thru1"
+(syn-thru) create "thru2"
+(syn-thru) create "thru3"
+(syn-thru) exec child 1 of 4: "child-syn-thru 0"
+(syn-thru) exec child 2 of 4: "child-syn-thru 1"
+(syn-thru) exec child 3 of 4: "child-syn-thru 2"
+(syn-thru) exec child 4 of 4: "child-syn-thru 3"
+(syn-thru) wait for child 1 of 4 returned 0 (expected 0)
+(syn-thru) wait for child 2 of 4 returned 1 (expected 1)
+(syn-thru) wait for child 3 of 4 returned 2 (expected 2)
+(syn-thru) wait for child 4 of 4 returned 3 (expected 3)
+(syn-thru) end
+EOF
+pass;
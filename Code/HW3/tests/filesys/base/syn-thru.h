@@ -0,0 +1,13 @@
+#ifndef TESTS_FILESYS_BASE_SYN_THRU_H
+#define TESTS_FILESYS_BASE_SYN_THRU_H
+
+#define CHILD_CNT 4
+#define FILE_SIZE 16384
+#define BLOCK_SIZE 512
+#define PASS_CNT 4
+
+/* Bytes moved by all the children together: each pass writes
+   and then reads back the whole file. */
+#define TOTAL_BYTES (2 * CHILD_CNT * PASS_CNT * FILE_SIZE)
+
+#endif /* tests/filesys/base/syn-thru.h */
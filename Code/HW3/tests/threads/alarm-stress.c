@@ -0,0 +1,86 @@
+/* Puts 2048 threads to sleep at once, for lengths spread over
+   several hundred ticks, and checks that none of them wakes up
+   early.  Reports the average number of CPU cycles spent in the
+   timer interrupt per tick while they sleep, which should not
+   grow with the number of sleepers. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SLEEPER_CNT 2048
+#define ITER_CNT 4
+
+struct sleeper 
+  {
+    int64_t duration;           /* Ticks to sleep each time. */
+    int early_wakeups;          /* Times woken before duration. */
+  };
+
+static struct semaphore done;
+static struct sleeper sleepers[SLEEPER_CNT];
+
+static thread_func sleeper_thread;
+
+void
+test_alarm_stress (void) 
+{
+  int64_t start_ticks, ticks;
+  uint64_t start_cycles, cycles;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&done, 0);
+
+  /* Keep the CPU until every thread exists. */
+  thread_set_priority (PRI_MAX);
+  for (i = 0; i < SLEEPER_CNT; i++) 
+    {
+      struct sleeper *s = &sleepers[i];
+      char name[16];
+
+      s->duration = 1 + i * 7 % 293;
+      s->early_wakeups = 0;
+      snprintf (name, sizeof name, "sleeper %d", i);
+      if (thread_create (name, PRI_DEFAULT, sleeper_thread, s) == TID_ERROR)
+        fail ("could not create sleeper %d", i);
+    }
+  msg ("%d sleepers created.", SLEEPER_CNT);
+
+  start_ticks = timer_ticks ();
+  start_cycles = timer_interrupt_cycles ();
+  for (i = 0; i < SLEEPER_CNT; i++)
+    sema_down (&done);
+  ticks = timer_elapsed (start_ticks);
+  cycles = timer_interrupt_cycles () - start_cycles;
+
+  for (i = 0; i < SLEEPER_CNT; i++)
+    if (sleepers[i].early_wakeups != 0)
+      fail ("sleeper %d woke up early %d times",
+            i, sleepers[i].early_wakeups);
+  msg ("All sleepers woke up on time.");
+
+  msg ("timer interrupt: %llu cycles per tick",
+       ticks > 0 ? cycles / ticks : 0);
+}
+
+static void
+sleeper_thread (void *s_) 
+{
+  struct sleeper *s = s_;
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      int64_t start = timer_ticks ();
+      timer_sleep (s->duration);
+      if (timer_elapsed (start) < s->duration)
+        s->early_wakeups++;
+    }
+  sema_up (&done);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The cycle count varies from run to run.
+@output = grep (!/^\(alarm-stress\) timer interrupt: \d+ cycles per tick$/,
+                @output);
+compare_output ("run", \@output, [<<'EOF']);
+(alarm-stress) begin
+(alarm-stress) 2048 sleepers created.
+(alarm-stress) All sleepers woke up on time.
+(alarm-stress) end
+EOF
+pass;
@@ -0,0 +1,84 @@
+/* Starts 60 threads that spin for 10 seconds, like mlfqs-load-60,
+   alongside 500 threads that stay blocked the whole time, and
+   reports the longest the timer interrupt handler ran with
+   interrupts off.  The once-a-second MLFQS update should only
+   cost time for threads that are running or ready, so the blocked
+   threads should not show up in the worst case. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SPINNER_CNT 60
+#define BLOCKED_CNT 500
+
+static int64_t start_time;
+static struct semaphore release;
+static struct semaphore done;
+
+static thread_func spin_thread;
+static thread_func blocked_thread;
+
+void
+test_mlfqs_latency (void) 
+{
+  uint64_t worst;
+  int i;
+
+  ASSERT (thread_mlfqs);
+
+  sema_init (&release, 0);
+  sema_init (&done, 0);
+  start_time = timer_ticks ();
+  msg ("Starting %d spinning threads and %d blocked threads.",
+       SPINNER_CNT, BLOCKED_CNT);
+  for (i = 0; i < BLOCKED_CNT; i++) 
+    {
+      char name[16];
+      snprintf (name, sizeof name, "blocked %d", i);
+      if (thread_create (name, PRI_DEFAULT, blocked_thread, NULL)
+          == TID_ERROR)
+        fail ("could not create blocked thread %d", i);
+    }
+  for (i = 0; i < SPINNER_CNT; i++) 
+    {
+      char name[16];
+      snprintf (name, sizeof name, "spin %d", i);
+      if (thread_create (name, PRI_DEFAULT, spin_thread, NULL) == TID_ERROR)
+        fail ("could not create spinning thread %d", i);
+    }
+
+  /* Measure while the spinners run. */
+  timer_sleep (start_time + TIMER_FREQ - timer_ticks ());
+  timer_interrupt_max_cycles ();
+  timer_sleep (10 * TIMER_FREQ);
+  worst = timer_interrupt_max_cycles ();
+
+  for (i = 0; i < SPINNER_CNT; i++)
+    sema_down (&done);
+  msg ("Spinning threads finished.");
+  for (i = 0; i < BLOCKED_CNT; i++)
+    sema_up (&release);
+
+  msg ("worst timer interrupt: %llu cycles", worst);
+}
+
+static void
+spin_thread (void *aux UNUSED) 
+{
+  int64_t spin_until = start_time + 11 * TIMER_FREQ;
+
+  timer_sleep (start_time + TIMER_FREQ - timer_ticks ());
+  while (timer_ticks () < spin_until)
+    continue;
+  sema_up (&done);
+}
+
+static void
+blocked_thread (void *aux UNUSED) 
+{
+  sema_down (&release);
+}
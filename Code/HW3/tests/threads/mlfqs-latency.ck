@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The cycle count varies from run to run.
+@output = grep (!/^\(mlfqs-latency\) worst timer interrupt: \d+ cycles$/,
+                @output);
+compare_output ("run", \@output, [<<'EOF']);
+(mlfqs-latency) begin
+(mlfqs-latency) Starting 60 spinning threads and 500 blocked threads.
+(mlfqs-latency) Spinning threads finished.
+(mlfqs-latency) end
+EOF
+pass;
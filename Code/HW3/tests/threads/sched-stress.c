@@ -0,0 +1,74 @@
+/* Creates 512 threads spread over a few priorities, has each of
+   them yield many times, and reports how many context switches
+   per second the scheduler sustained.  With a linear run queue
+   every yield walks all the ready threads; with per-priority
+   queues the cost of a switch should not depend on the thread
+   count. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 512
+#define ITER_CNT 32
+#define PRI_SPREAD 4
+
+static struct semaphore done;
+static int iterations[THREAD_CNT];
+
+static thread_func stress_thread;
+
+void
+test_sched_stress (void) 
+{
+  int64_t start, ticks;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&done, 0);
+
+  /* Keep the CPU until every thread exists. */
+  thread_set_priority (PRI_MAX);
+  for (i = 0; i < THREAD_CNT; i++) 
+    {
+      char name[16];
+      snprintf (name, sizeof name, "stress %d", i);
+      if (thread_create (name, PRI_DEFAULT - i % PRI_SPREAD, stress_thread,
+                         &iterations[i]) == TID_ERROR)
+        fail ("could not create thread %d", i);
+    }
+  msg ("%d threads created.", THREAD_CNT);
+
+  start = timer_ticks ();
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+  ticks = timer_elapsed (start);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    if (iterations[i] != ITER_CNT)
+      fail ("thread %d ran %d iterations, expected %d",
+            i, iterations[i], ITER_CNT);
+  msg ("All threads finished.");
+
+  msg ("context switches: %lld per second",
+       (long long) THREAD_CNT * ITER_CNT * TIMER_FREQ
+       / (ticks > 0 ? ticks : 1));
+}
+
+static void
+stress_thread (void *iterations_) 
+{
+  int *iterations = iterations_;
+
+  while (*iterations < ITER_CNT)
+    {
+      ++*iterations;
+      thread_yield ();
+    }
+  sema_up (&done);
+}
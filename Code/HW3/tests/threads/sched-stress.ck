@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The switch rate varies from run to run.
+@output = grep (!/^\(sched-stress\) context switches: \d+ per second$/,
+                @output);
+compare_output ("run", \@output, [<<'EOF']);
+(sched-stress) begin
+(sched-stress) 512 threads created.
+(sched-stress) All threads finished.
+(sched-stress) end
+EOF
+pass;
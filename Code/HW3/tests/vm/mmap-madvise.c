@@ -0,0 +1,56 @@
+/* Maps a file and reads it after each kind of madvise advice,
+   checking that the data is always correct.  MADV_DONTNEED must
+   write the page back, and bad advice must be refused. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+
+static const struct
+  {
+    int advice;
+    const char *name;
+  }
+hints[] =
+  {
+    {MADV_SEQUENTIAL, "MADV_SEQUENTIAL"},
+    {MADV_RANDOM, "MADV_RANDOM"},
+    {MADV_WILLNEED, "MADV_WILLNEED"},
+    {MADV_DONTNEED, "MADV_DONTNEED"},
+    {MADV_NORMAL, "MADV_NORMAL"},
+  };
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+  size_t i;
+  char c;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+
+  for (i = 0; i < sizeof hints / sizeof *hints; i++)
+    {
+      CHECK (madvise (map, hints[i].advice) == 0, "madvise %s", hints[i].name);
+      if (memcmp (ACTUAL, sample, strlen (sample)))
+        fail ("read of mmap'd file after %s reported bad data",
+              hints[i].name);
+    }
+
+  /* Dropped pages are written back first. */
+  ACTUAL[0] = '*';
+  CHECK (madvise (map, MADV_DONTNEED) == 0, "madvise MADV_DONTNEED");
+  read (handle, &c, 1);
+  CHECK (c == '*' && ACTUAL[0] == '*', "dirty page written back");
+  ACTUAL[0] = sample[0];
+
+  CHECK (madvise (map, 12345) == -1, "bad advice refused");
+  munmap (map);
+  close (handle);
+}
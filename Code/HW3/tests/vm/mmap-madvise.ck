@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-madvise) begin
+(mmap-madvise) open "sample.txt"
+(mmap-madvise) mmap "sample.txt"
+(mmap-madvise) madvise MADV_SEQUENTIAL
+(mmap-madvise) madvise MADV_RANDOM
+(mmap-madvise) madvise MADV_WILLNEED
+(mmap-madvise) madvise MADV_DONTNEED
+(mmap-madvise) madvise MADV_NORMAL
+(mmap-madvise) madvise MADV_DONTNEED
+(mmap-madvise) dirty page written back
+(mmap-madvise) bad advice refused
+(mmap-madvise) end
+EOF
+pass;
@@ -0,0 +1,41 @@
+/* Writes to a file through a mapping, then uses msync to write
+   the data back and reads it with the read system call while the
+   mapping is still in place.  Writes after msync must reach the
+   file as well, when the file is unmapped. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+  char buf[1024];
+
+  CHECK (create ("sample.txt", strlen (sample)), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  memcpy (ACTUAL, sample, strlen (sample));
+  CHECK (msync (map) == 0, "msync \"sample.txt\"");
+
+  /* Read back via read() while still mapped. */
+  read (handle, buf, strlen (sample));
+  CHECK (!memcmp (buf, sample, strlen (sample)),
+         "compare read data against written data");
+
+  /* Change the first byte and unmap. */
+  *(char *) ACTUAL = '*';
+  munmap (map);
+  seek (handle, 0);
+  read (handle, buf, 1);
+  CHECK (buf[0] == '*', "compare first byte after munmap");
+
+  CHECK (msync (map) == -1, "msync of unmapped mapping fails");
+  close (handle);
+}
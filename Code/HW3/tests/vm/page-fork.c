@@ -0,0 +1,64 @@
+/* Fills a 128 kB array, forks, and checks that writes made by
+   either process after the fork stay private to that process.
+   The first child overwrites the array and the parent checks its
+   own copy afterward; for the second fork the parent overwrites
+   its copy and the child checks that it still sees the old
+   data. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (128 * 1024)
+static char buf[SIZE];
+
+/* Exits with status 1 unless every byte of buf is C. */
+static void
+expect (char c, int status)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != c)
+      exit (1);
+  exit (status);
+}
+
+static void
+check (char c, const char *who)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != c)
+      fail ("%s byte %zu is %d instead of %d", who, i, buf[i], c);
+}
+
+void
+test_main (void)
+{
+  pid_t child;
+
+  memset (buf, 'a', SIZE);
+
+  child = fork ();
+  if (child == 0)
+    {
+      memset (buf, 'c', SIZE);
+      expect ('c', 0x42);
+    }
+  CHECK (child != -1, "fork");
+  CHECK (wait (child) == 0x42, "wait for child");
+  check ('a', "parent's");
+  msg ("parent's copy unchanged");
+
+  child = fork ();
+  if (child == 0)
+    expect ('a', 0x43);
+  CHECK (child != -1, "fork again");
+  memset (buf, 'p', SIZE);
+  CHECK (wait (child) == 0x43, "wait for child");
+  check ('p', "parent's");
+  msg ("child's copy unchanged");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-fork) begin
+(page-fork) fork
+(page-fork) wait for child
+(page-fork) parent's copy unchanged
+(page-fork) fork again
+(page-fork) wait for child
+(page-fork) child's copy unchanged
+(page-fork) end
+EOF
+pass;
@@ -0,0 +1,62 @@
+/* Fills 2 MB of memory with pages that compress well, each
+   different from the others, so that far more of them pass
+   through swap than the compressed cache holds, and then checks
+   every page twice. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+#define PAGE_SIZE 4096
+#define PAGE_CNT (SIZE / PAGE_SIZE)
+
+static char buf[SIZE];
+
+/* Returns the byte that fills page I. */
+static char
+fill_byte (size_t i)
+{
+  return i * 7 + 1;
+}
+
+/* Checks that each page holds its index followed by its fill
+   byte. */
+static void
+check_pages (void)
+{
+  size_t i, j;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    {
+      char *page = buf + i * PAGE_SIZE;
+
+      if (*(size_t *) page != i)
+        fail ("page %zu starts with %zu", i, *(size_t *) page);
+      for (j = sizeof i; j < PAGE_SIZE; j++)
+        if (page[j] != fill_byte (i))
+          fail ("byte %zu of page %zu is %d, not %d",
+                j, i, page[j], fill_byte (i));
+    }
+}
+
+void
+test_main (void)
+{
+  size_t i;
+
+  msg ("initialize");
+  for (i = 0; i < PAGE_CNT; i++)
+    {
+      char *page = buf + i * PAGE_SIZE;
+
+      memset (page, fill_byte (i), PAGE_SIZE);
+      *(size_t *) page = i;
+    }
+
+  msg ("read pass");
+  check_pages ();
+
+  msg ("read pass");
+  check_pages ();
+}
@@ -0,0 +1,30 @@
+/* Recurses about 1 MB deep, so that the stack has to grow by
+   hundreds of pages one frame at a time, then checks that every
+   frame kept its contents.
+   This must succeed. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define DEPTH 4096
+
+/* Returns DEPTH - N if each frame still holds what it wrote. */
+static int
+recurse (int n)
+{
+  volatile char pad[240];
+  int depth;
+
+  memset ((char *) pad, n & 0xff, sizeof pad);
+  depth = n < DEPTH ? recurse (n + 1) : 0;
+  if (pad[n % sizeof pad] != (char) (n & 0xff))
+    fail ("frame %d was overwritten", n);
+  return depth + 1;
+}
+
+void
+test_main (void)
+{
+  msg ("recursed %d frames deep", recurse (1));
+}
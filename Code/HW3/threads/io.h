@@ -112,4 +112,28 @@ outsl (uint16_t port, const void *addr, size_t cnt)
   asm volatile ("rep outsl" : "+S" (addr), "+c" (cnt) : "d" (port));
 }
 
+/* CPUID leaf 1 feature flags in EDX. */
+#define CPUID_PSE (1 << 3)      /* 4 MB pages. */
+#define CPUID_PGE (1 << 13)     /* Global pages. */
+
+/* Returns the EDX feature flags that CPUID reports for LEAF. */
+static inline uint32_t
+cpuid_edx (uint32_t leaf)
+{
+  /* See [IA32-v2a] "CPUID". */
+  uint32_t a, b, c, d;
+  asm volatile ("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (leaf));
+  return d;
+}
+
+/* Returns the processor's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  /* See [IA32-v2b] "RDTSC". */
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
 #endif /* threads/io.h */
@@ -71,7 +71,7 @@ sema_down (struct semaphore *sema)
   old_level = intr_disable ();
   while (sema->value == 0) 
   {
-      list_insert_ordered(&sema->waiters, &thread_current()->elem, cmp_priority,0);
+      list_push_back(&sema->waiters, &thread_current()->elem);
       thread_block ();
   }
   sema->value--;
@@ -118,9 +118,10 @@ sema_up (struct semaphore *sema)
   old_level = intr_disable ();
   if (!list_empty (&sema->waiters)) 
 	{
-		list_sort(&sema->waiters,cmp_priority,0);  
-	  thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                               struct thread, elem));
+		/* highest priority waiter, first come first served on ties */
+		struct list_elem *e = list_min(&sema->waiters,cmp_priority,0);
+		list_remove(e);
+	  thread_unblock (list_entry (e, struct thread, elem));
 	}  
 	sema->value++;
 
@@ -306,8 +307,13 @@ bool cmp_sema_priority(const struct list_elem* a, const struct list_elem*b, void
 	struct semaphore_elem* sa = list_entry(a, struct semaphore_elem, elem);
 	struct semaphore_elem* sb = list_entry(b, struct semaphore_elem, elem);
 
-	return list_entry(list_front(&sa->semaphore.waiters), struct thread, elem)->priority 
-									 > list_entry(list_front(&sb->semaphore.waiters), struct thread, elem)->priority;	
+	/* a waiter may not have reached sema_down() yet */
+	int pa = list_empty(&sa->semaphore.waiters) ? PRI_MIN
+					 : list_entry(list_front(&sa->semaphore.waiters), struct thread, elem)->priority;
+	int pb = list_empty(&sb->semaphore.waiters) ? PRI_MIN
+					 : list_entry(list_front(&sb->semaphore.waiters), struct thread, elem)->priority;
+
+	return pa > pb;
 
 }
 
@@ -322,7 +328,9 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
-  list_insert_ordered(&cond->waiters, &waiter.elem,cmp_sema_priority,0);
+  /* waiter.semaphore has no waiter yet, so cmp_sema_priority()
+     cannot order it here; cond_signal() picks the highest. */
+  list_push_back (&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
   lock_acquire (lock);
@@ -345,9 +353,9 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
 
   if (!list_empty (&cond->waiters)) 
 	{
-		list_sort(&cond->waiters,cmp_sema_priority,0);
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+		struct list_elem *e = list_min(&cond->waiters,cmp_sema_priority,0);
+		list_remove(e);
+    sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
 	
 	}
 }
@@ -368,3 +376,79 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes readers-writer lock RW.  Any number of readers
+   may hold RW at once, but a writer holds it alone.  Waiting
+   writers are preferred over new readers, so a stream of
+   readers cannot starve a writer. */
+void
+rw_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->lock);
+  cond_init (&rw->can_read);
+  cond_init (&rw->can_write);
+  rw->readers = 0;
+  rw->waiting_writers = 0;
+  rw->writer = false;
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+   is waiting for it. */
+void
+rw_read_acquire (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  while (rw->writer || rw->waiting_writers > 0)
+    cond_wait (&rw->can_read, &rw->lock);
+  rw->readers++;
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for reading. */
+void
+rw_read_release (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->readers > 0);
+  if (--rw->readers == 0)
+    cond_signal (&rw->can_write, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until no reader or other
+   writer holds it. */
+void
+rw_write_acquire (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  rw->waiting_writers++;
+  while (rw->writer || rw->readers > 0)
+    cond_wait (&rw->can_write, &rw->lock);
+  rw->waiting_writers--;
+  rw->writer = true;
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for writing. */
+void
+rw_write_release (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->writer);
+  rw->writer = false;
+  if (rw->waiting_writers > 0)
+    cond_signal (&rw->can_write, &rw->lock);
+  else
+    cond_broadcast (&rw->can_read, &rw->lock);
+  lock_release (&rw->lock);
+}
@@ -12,6 +12,7 @@
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -29,20 +30,41 @@
 /* load average count of process in 1 min */
 int load_avg;
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Number of load_avg updates (once a second) so far.  Blocked
+   threads skip the once-a-second recent_cpu update; they catch up
+   when they next become ready, using the decay factors of the
+   epochs they missed, kept in decay_factors[epoch % DECAY_WINDOW]. */
+#define DECAY_WINDOW 64
+static int mlfqs_epoch;
+static int decay_factors[DECAY_WINDOW];
+
+/* Run queue: processes in THREAD_READY state, that is, processes
+   that are ready to run but not actually running.  There is one
+   FIFO queue per priority, bit P of ready_bitmap is set when
+   ready_queues[P] is nonempty, and ready_threads counts all of
+   them, so that every run queue operation is O(1). */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_bitmap;
+static int ready_threads;
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
-/* Sleep queue */
-static struct list sleep_list;			
-
-/* Save the smallest tick */  		
-static int64_t next_tick_to_awake;							
-
+/* Sleep queue: a hierarchical timing wheel.  A sleeper whose
+   wakeup_tick is less than 64**(L+1) ticks after wheel_now sits
+   on level L, in the slot picked by bits 6L..6L+5 of its
+   wakeup_tick.  Each time a level's lower bits wrap around, the
+   current slot of that level is moved down a level, so sleepers
+   reach level 0 by the tick they must wake on.  Sleeping and
+   waking are O(1), and each sleeper is moved at most once per
+   level. */
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+static struct list sleep_wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static struct list sleep_overflow;	/* Beyond the top level. */
+static int64_t wheel_now;				/* Last tick processed. */
 
 /* Idle thread. */
 static struct thread *idle_thread;
@@ -86,6 +108,11 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static int ready_max_priority (void);
+static void wheel_insert (struct thread *);
+static void wheel_cascade (int level);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -103,12 +130,17 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (i = 0; i <= PRI_MAX; i++)
+    list_init (&ready_queues[i]);
   list_init (&all_list);
-	list_init (&sleep_list);
+	for (i = 0; i < WHEEL_LEVELS * WHEEL_SIZE; i++)
+		list_init (&sleep_wheel[i / WHEEL_SIZE][i % WHEEL_SIZE]);
+	list_init (&sleep_overflow);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -274,13 +306,18 @@ void
 thread_unblock (struct thread *t) 
 {
   enum intr_level old_level;
-	struct list_elem *e;
   ASSERT (is_thread (t));
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
 
-	list_insert_ordered(&ready_list,&t->elem,cmp_priority,0);	/* Sort by priority in ready list */
+	/* catch up on the recent_cpu decay missed while blocked */
+	if(thread_mlfqs)
+	{
+		mlfqs_recent_cpu(t);
+		mlfqs_priority(t);
+	}
+	ready_push(t);		/* queue at its priority */
 
   t->status = THREAD_READY;
   intr_set_level (old_level);
@@ -356,61 +393,114 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-		list_insert_ordered(&ready_list,&cur->elem,cmp_priority,0); /* insert order by priorirty */
+		ready_push(cur);	/* back of its priority queue */
 	cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
 }
 
-/* Make thread block and push sleep list func */
+/* Make thread block until timer tick TICKS */
 void thread_sleep(int64_t ticks) 
 {
 	struct thread *t = thread_current();
-	
-	intr_disable();															/* change interrupt disable */
-	if(t != idle_thread)
+	enum intr_level old_level;
+
+	ASSERT(t != idle_thread);
+
+	old_level = intr_disable();
+	if(ticks > wheel_now)
 	{		
 		t->wakeup_tick = ticks;
-		list_push_back(&sleep_list,&t->elem);			/* push sleep list */
-		update_next_tick_to_awake(ticks);					/* compare next_tick to ticks */ 
+		wheel_insert(t);
 		thread_block();		
 	}
-	intr_enable();															/* change interrupt enable */
+	intr_set_level(old_level);
 }
 
-/* Make thread unblock and pop sleep list func */
+/* Awake sleeping threads whose wakeup_tick has come, up to TICKS.
+   Called from the timer interrupt on every tick. */
 void thread_awake(int64_t ticks) 
 {
-	struct list_elem *e;
-		
-	for(e = list_begin(&sleep_list); e != list_end(&sleep_list); )	/* all thread in sleep list */
+	bool woke = false;
+	int level;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	while(wheel_now < ticks)
 	{
-		struct thread *t = list_entry(e,struct thread,elem);					
-		if(t->wakeup_tick <= ticks) 																	/* wakeup condition */
+		struct list *slot;
+
+		wheel_now++;
+
+		/* move down sleepers that are now close enough, top level first */
+		if((wheel_now & (((int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1)) == 0)
+			while(!list_empty(&sleep_overflow))
+				wheel_insert(list_entry(list_pop_front(&sleep_overflow),struct thread,elem));
+		for(level = WHEEL_LEVELS - 1; level > 0; level--)
+			if((wheel_now & (((int64_t) 1 << (WHEEL_BITS * level)) - 1)) == 0)
+				wheel_cascade(level);
+
+		/* everyone left in this slot wakes up now */
+		slot = &sleep_wheel[0][wheel_now & (WHEEL_SIZE - 1)];
+		while(!list_empty(slot))
 		{
-			e = list_remove(&t->elem);																	/* pop sleep list */
+			struct thread *t = list_entry(list_pop_front(slot),struct thread,elem);
+			ASSERT(t->wakeup_tick == wheel_now);
 			thread_unblock(t);
-		}
-		else 
-		{
-			e = list_next(e);	
-			update_next_tick_to_awake(t->wakeup_tick);									/* compare next_tick to wakeup_tick */
+			woke = true;
 		}
 	}
+
+	if(woke)
+		test_max_priority();
 }
 
-/* Set next_tick_to_awake func */
-void update_next_tick_to_awake(int64_t ticks) 
+/* Return how many ticks after NOW the next sleeper may be due, or MAX
+   if none can be due sooner.  A tick on which the wheel moves
+   sleepers down from level 1 counts as due, since one of them might
+   wake on a tick just after it.  NOW may be ahead of the last tick
+   the wheel has processed; sleepers due in between count as due on
+   the next tick. */
+int thread_ticks_to_wakeup(int64_t now, int max)
 {
-	if(ticks < next_tick_to_awake)																	/* compare next_tick to ticks */
-		next_tick_to_awake = ticks; 					
+	int64_t tick;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+	ASSERT(now + max - wheel_now <= WHEEL_SIZE);
+
+	for(tick = wheel_now + 1; tick < now + max; tick++)
+		if((tick & (WHEEL_SIZE - 1)) == 0
+		   || !list_empty(&sleep_wheel[0][tick & (WHEEL_SIZE - 1)]))
+			return tick > now ? tick - now : 1;
+	return max;
 }
 
-/* return next_tick_to_awake func */
-int64_t get_next_tick_to_awake(void) 
+/* Put sleeping thread T on the wheel level and slot for its wakeup_tick */
+static void wheel_insert(struct thread *t)
 {
-	return next_tick_to_awake;
+	int64_t delta = t->wakeup_tick - wheel_now;
+	int level;
+
+	for(level = 0; level < WHEEL_LEVELS; level++)
+		if(delta < (int64_t) 1 << (WHEEL_BITS * (level + 1)))
+		{
+			int idx = (t->wakeup_tick >> (WHEEL_BITS * level)) & (WHEEL_SIZE - 1);
+			list_push_back(&sleep_wheel[level][idx],&t->elem);
+			return;
+		}
+	list_push_back(&sleep_overflow,&t->elem);
 }
+
+/* Move the sleepers in LEVEL's current slot down to lower levels */
+static void wheel_cascade(int level)
+{
+	int idx = (wheel_now >> (WHEEL_BITS * level)) & (WHEEL_SIZE - 1);
+	struct list *slot = &sleep_wheel[level][idx];
+
+	while(!list_empty(slot))
+		wheel_insert(list_entry(list_pop_front(slot),struct thread,elem));
+}
+
 /* Invoke function 'func' on all threads, passing along 'aux'.
    This function must be called with interrupts off. */
 void
@@ -428,17 +518,23 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Compare priority the most thread in ready_list to current thread */
+/* Compare priority the most thread in run queue to current thread */
 void test_max_priority(void) 
 {
 	enum intr_level old_level;
 	old_level = intr_disable();
 
-	/*Check empty and Compare current thread to first thread in ready_list */
-	if(!list_empty(&ready_list) && thread_current()->priority < list_entry(list_front(&ready_list),struct thread,elem)->priority)
+	/* Check empty and Compare current thread to highest ready priority */
+	if(ready_threads > 0 && thread_current()->priority < ready_max_priority())
 	{			
-		intr_set_level(old_level);
-		thread_yield();	
+		/* can't yield inside an interrupt handler; yield on return */
+		if(intr_context())
+			intr_yield_on_return();
+		else
+		{
+			intr_set_level(old_level);
+			thread_yield();	
+		}
 	}
 
 	intr_set_level(old_level);
@@ -476,6 +572,8 @@ thread_set_nice (int nice UNUSED)
 	intr_disable();
 
 	thread_current()->nice = nice;
+	if(thread_mlfqs)
+		mlfqs_priority(thread_current());
 	test_max_priority();
 
 	intr_enable();
@@ -540,19 +638,10 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
-      /* Re-enable interrupts and wait for the next one.
-
-         The `sti' instruction disables interrupts until the
-         completion of the next instruction, so these two
-         instructions are executed atomically.  This atomicity is
-         important; otherwise, an interrupt could be handled
-         between re-enabling interrupts and waiting for the next
-         one to occur, wasting as much as one clock tick worth of
-         time.
-
-         See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-         7.11.1 "HLT Instruction". */
-      asm volatile ("sti; hlt" : : : "memory");
+      /* Re-enable interrupts and wait for the next one.  With
+         -tickless, the timer stays quiet until the next sleeper
+         is due. */
+      timer_idle ();
     }
 }
 
@@ -609,6 +698,7 @@ init_thread (struct thread *t, const char *name, int priority)
 	
 	t->nice = NICE_DEFAULT;
 	t->recent_cpu = RECENT_CPU_DEFAULT;
+	t->recent_cpu_epoch = mlfqs_epoch;
 
 	/* initialize donation priority */ 
 	list_init(&t->donations);
@@ -637,10 +727,59 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  struct thread *t;
+
+  if (ready_threads == 0)
     return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+
+  t = list_entry (list_front (&ready_queues[ready_max_priority ()]),
+                  struct thread, elem);
+  ready_remove (t);
+  return t;
+}
+
+/* Adds T to the back of the run queue for its priority.
+   Interrupts must be off. */
+static void
+ready_push (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_bitmap |= (uint64_t) 1 << t->priority;
+  ready_threads++;
+}
+
+/* Removes T from the run queue.  Interrupts must be off. */
+static void
+ready_remove (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[t->priority]))
+    ready_bitmap &= ~((uint64_t) 1 << t->priority);
+  ready_threads--;
+}
+
+/* Returns the highest priority with a ready thread.  The run
+   queue must not be empty. */
+static int
+ready_max_priority (void)
+{
+  uint32_t hi = ready_bitmap >> 32;
+  uint32_t lo = ready_bitmap;
+  uint32_t bit;
+
+  ASSERT (ready_bitmap != 0);
+
+  if (hi != 0)
+    {
+      asm ("bsrl %1, %0" : "=r" (bit) : "rm" (hi));
+      return bit + 32;
+    }
+  asm ("bsrl %1, %0" : "=r" (bit) : "rm" (lo));
+  return bit;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -742,35 +881,60 @@ void mlfqs_priority(struct thread *t)
 	priority = sub_fp(priority,p1);
 	priority = sub_fp(priority,p2);
 
-	t->priority = fp_to_int(priority);
+	priority = fp_to_int(priority);
+	if(priority > PRI_MAX)
+		priority = PRI_MAX;
+	else if(priority < PRI_MIN)
+		priority = PRI_MIN;
+
+	/* a ready thread moves to the queue of its new priority */
+	if(t->status == THREAD_READY && t->priority != priority)
+	{
+		ready_remove(t);
+		t->priority = priority;
+		ready_push(t);
+	}
+	else
+		t->priority = priority;
 }
 
-/* Calculate recent_cpu by mlfqs_formula */
+/* Bring recent_cpu of T up to the current epoch by mlfqs_formula,
+   once per epoch missed */
 void mlfqs_recent_cpu(struct thread *t) 
 {
-	if(t == idle_thread)
+	int missed = mlfqs_epoch - t->recent_cpu_epoch;
+	int nice = int_to_fp(t->nice);
+	int epoch;
+
+	if(t == idle_thread || missed == 0)
 		return ;
-	
-	int c1 = mult_mixed(load_avg,2);
-	int c2 = add_mixed(mult_mixed(load_avg,2),1);
-	int c3 = t->recent_cpu;
-	int c4 = int_to_fp(t->nice);
-	t->recent_cpu = add_fp(mult_fp(div_fp(c1,c2),c3),c4);
+
+	/* older factors are gone; repeat the oldest one we have,
+	   using the closed form c^m*rc + nice*(1-c^m)/(1-c) */
+	if(missed > DECAY_WINDOW)
+	{
+		int c = decay_factors[(mlfqs_epoch - DECAY_WINDOW) % DECAY_WINDOW];
+		int cm = int_to_fp(1);
+		int base = c;
+		int m = missed - DECAY_WINDOW;
+
+		for(; m > 0; m >>= 1, base = mult_fp(base,base))
+			if(m & 1)
+				cm = mult_fp(cm,base);
+		t->recent_cpu = add_fp(mult_fp(cm,t->recent_cpu),
+			div_fp(mult_fp(nice,sub_fp(int_to_fp(1),cm)),sub_fp(int_to_fp(1),c)));
+		missed = DECAY_WINDOW;
+	}
+
+	for(epoch = mlfqs_epoch - missed; epoch < mlfqs_epoch; epoch++)
+		t->recent_cpu = add_fp(mult_fp(decay_factors[epoch % DECAY_WINDOW],t->recent_cpu),nice);
+	t->recent_cpu_epoch = mlfqs_epoch;
 }
 
-/* Calculate the number of ready list and current_thread */
+/* Calculate the number of ready threads and current_thread */
 int ready_count(void) 
 {
-	struct list_elem *e;
-	int n = 0;
-	
-	for(e = list_begin(&ready_list); e != list_end(&ready_list); e = list_next(e))
-		n++;
-	
-	if(thread_current() == idle_thread)	
-		n -= 1;
-
-	return n + 1;
+	return ready_threads + (thread_current() != idle_thread ? 1 : 0);
 }
 
 /* Calculate load_avg by mlfqs_formula */
@@ -796,20 +960,37 @@ void mlfqs_increment(void)
 	thread_current()->recent_cpu = add_mixed(thread_current()->recent_cpu,1);
 }
 
-/* Calculate all thread by load_avg, recent_cpu, priority */
+/* Calculate load_avg, then recent_cpu and priority of the running and
+   ready threads.  Blocked threads are left for thread_unblock(). */
 void mlfqs_recalc(void)
 {
-	struct list_elem *e;
+	int i;
+
 	mlfqs_load_avg();
 
-	for(e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e))
+	/* start a new epoch with this second's decay factor */
+	decay_factors[mlfqs_epoch % DECAY_WINDOW] =
+		div_fp(mult_mixed(load_avg,2),add_mixed(mult_mixed(load_avg,2),1));
+	mlfqs_epoch++;
+
+	mlfqs_recent_cpu(thread_current());
+	mlfqs_priority(thread_current());
+
+	/* a thread moved to a queue not yet visited is seen twice,
+	   but the second visit changes nothing */
+	for(i = PRI_MIN; i <= PRI_MAX; i++)
 	{
-		struct thread *t = list_entry(e,struct thread,allelem);
-		
-		mlfqs_recent_cpu(t);
-		mlfqs_priority(t);		
-	}
+		struct list_elem *e, *next;
+
+		for(e = list_begin(&ready_queues[i]); e != list_end(&ready_queues[i]); e = next)
+		{
+			struct thread *t = list_entry(e,struct thread,elem);
 
+			next = list_next(e);
+			mlfqs_recent_cpu(t);
+			mlfqs_priority(t);
+		}
+	}
 }
 
 
@@ -120,6 +120,7 @@ struct thread
     
 		int nice;
 		int recent_cpu;
+		int recent_cpu_epoch;								/* mlfqs epoch recent_cpu is current for */
 
 		int init_priority;									/* save init_priority to initialize after donation */
 		struct lock* wait_on_lock;					/* save address of lock struct that current thread wait */
@@ -132,13 +133,17 @@ struct thread
     unsigned magic;                     /* Detects stack overflow. */
 
 		struct hash vm;											/* hashtable that managed virtual memory */
+		void *user_esp;											/* user esp at system call entry */
+		uint8_t *stack_bottom;							/* lowest page of the user stack */
+		size_t stack_grow;									/* pages mapped ahead by the last stack growth */
+		void *fault_next;										/* first page after the last fault-around */
+		size_t fault_window;								/* pages mapped by the next fault-around */
   };
 
 
 void thread_sleep(int64_t ticks);				/* Make run thread to sleep */
 void thread_awake(int64_t ticks);				/* Awake thread in sleep queue */
-void update_next_tick_to_awake(int64_t ticks); /* Save the smallest tick */
-int64_t get_next_tick_to_awake(void);		/* Return next_tick_to_awake */
+int thread_ticks_to_wakeup(int64_t now, int max);		/* Ticks until the next sleeper may be due */
 
 void test_max_priority(void);						/* Compare current thread priority to the topmost thread priority in ready list */
 bool cmp_priority(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED);	/* Compare factor thread priority */
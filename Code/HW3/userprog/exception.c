@@ -3,13 +3,33 @@
 #include <stdio.h>
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
+#include "threads/io.h"
 #include "threads/thread.h"
+#include "vm/frame.h"
 #include "vm/page.h"
 #include "threads/vaddr.h"
+#include "userprog/uaccess.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
+/* Faults that loaded a page, and the cycles spent loading. */
+static long long page_in_fault_cnt;
+static long long page_in_fault_cycles;
+
+/* Faults that grew a user stack. */
+static long long stack_grow_cnt;
+
+/* Page-in faults by latency: bucket I counts faults that took
+   from 2**I up to 2**(I+1) cycles. */
+#define LATENCY_BUCKETS 48
+static long long page_in_latency[LATENCY_BUCKETS];
+
+static void record_latency (uint64_t cycles);
+static uint64_t latency_percentile (int percent);
+
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
 
@@ -67,6 +87,44 @@ void
 exception_print_stats (void) 
 {
   printf ("Exception: %lld page faults\n", page_fault_cnt);
+  if (stack_grow_cnt > 0)
+    printf ("Exception: %lld stack growth faults\n", stack_grow_cnt);
+  if (page_in_fault_cnt > 0)
+    printf ("Exception: %lld page-in faults, %lld cycles each on average\n",
+            page_in_fault_cnt, page_in_fault_cycles / page_in_fault_cnt);
+  if (page_in_fault_cnt > 0)
+    printf ("Exception: page-in latency p50 < %llu, p90 < %llu, "
+            "p99 < %llu cycles\n", latency_percentile (50),
+            latency_percentile (90), latency_percentile (99));
+}
+
+/* Counts a page-in fault that took CYCLES. */
+static void
+record_latency (uint64_t cycles)
+{
+  int bucket = 0;
+
+  while (bucket < LATENCY_BUCKETS - 1 && cycles >= (2ULL << bucket))
+    bucket++;
+  page_in_latency[bucket]++;
+}
+
+/* Returns a bound that PERCENT percent of page-in faults took less
+   than, rounded up to a power of 2. */
+static uint64_t
+latency_percentile (int percent)
+{
+  long long want = (page_in_fault_cnt * percent + 99) / 100;
+  long long seen = 0;
+  int bucket;
+
+  for (bucket = 0; bucket < LATENCY_BUCKETS - 1; bucket++)
+    {
+      seen += page_in_latency[bucket];
+      if (seen >= want)
+        break;
+    }
+  return 2ULL << bucket;
 }
 
 /* Handler for an exception (probably) caused by a user process. */
@@ -150,18 +208,57 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
-	if(!not_present)
-		exit(-1);
-	
-	struct vm_entry *vme = find_vme(fault_addr);
-	
-	if(!vme)
-		exit(-1);
+	struct vm_entry *vme = NULL;
+
+	if(not_present && is_user_vaddr(fault_addr))
+		vme = find_vme(fault_addr);
+
+	/* grow the stack for an access at most 32 bytes below the user
+	   stack pointer, as PUSH (4 bytes) and PUSHA (32 bytes) make
+	   before they move it.  A fault in the kernel uses the stack
+	   pointer saved at system call entry */
+	if(vme == NULL && not_present && is_user_vaddr(fault_addr))
+	{
+		void *esp = user ? f->esp : thread_current()->user_esp;
+
+		if(fault_addr >= esp - 32 && expand_stack(fault_addr))
+		{
+			stack_grow_cnt++;
+			return;
+		}
+	}
+
+	if(vme != NULL && !(write && vme->writable == 0))
+	{
+		uint64_t start = rdtsc();
+
+		/* a read of a page nobody wrote needs no frame of its own */
+		bool loaded = (!write && map_zero_page(vme)) || handle_mm_fault(vme);
+
+		if(loaded)
+		{
+			uint64_t cycles = rdtsc() - start;
+
+			page_in_fault_cnt++;
+			page_in_fault_cycles += cycles;
+			record_latency(cycles);
+			return;
+		}
+	}
+
+	/* first write to a page shared copy-on-write since fork */
+	if(!not_present && write && is_user_vaddr(fault_addr))
+	{
+		vme = find_vme(fault_addr);
+		if(vme != NULL && vme->writable && unshare_page(vme))
+			return;
+	}
+
+	/* bad user pointer passed to copy_from_user() and friends */
+	if(!user && fixup_exception(f))
+		return;
 
-	if(write && vme->writable == 0) 
-			exit(-1);
-	if(!handle_mm_fault(vme))
-			exit(-1);
+	exit(-1);
 	
 	/*
   // If Occur Page Fault, Call exit(-1) 
@@ -24,13 +24,14 @@
 #include "vm/swap.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
+static bool add_stack_page(void *upage, bool map);
+static void argument_stack(char **parse, int count, void **esp);
+
+/* largest user stack in bytes, set with -stack */
+size_t stack_max = 8 * 1024 * 1024;
 
-struct thread* get_child_process(int pid);
-struct file* process_get_file(int fd); 
-void remove_child_process(struct thread *cp);
-int process_add_file(struct file *f);
-void process_close_file(int fd); 
 
 
 
@@ -135,7 +136,90 @@ start_process (void *file_name_)
   
 }
 
-void argument_stack(char **parse, int count, void **esp) 
+/* Starts a child of the current process that is a copy of it,
+   resuming from the system call whose interrupt frame is F.
+   Returns the new process's thread id, or TID_ERROR if the
+   thread cannot be created. */
+tid_t
+process_fork (struct intr_frame *f)
+{
+  struct intr_frame *if_copy;
+  tid_t tid;
+
+  /* The child may read the frame after this system call returns. */
+  if_copy = malloc (sizeof *if_copy);
+  if (if_copy == NULL)
+    return TID_ERROR;
+  memcpy (if_copy, f, sizeof *if_copy);
+
+  tid = thread_create (thread_current ()->name, PRI_DEFAULT,
+                       start_fork, if_copy);
+  if (tid == TID_ERROR)
+    free (if_copy);
+
+  return tid;
+}
+
+/* A thread function that copies the parent's address space and
+   open files, then returns to user mode where the parent made
+   the fork system call, with a return value of 0.  The parent
+   waits on sema_load, so its state holds still while we copy. */
+static void
+start_fork (void *if_copy)
+{
+  struct thread *cur = thread_current ();
+  struct thread *parent = cur->parent;
+  struct intr_frame if_;
+  int i;
+
+  memcpy (&if_, if_copy, sizeof if_);
+  free (if_copy);
+  if_.eax = 0;
+
+	vm_init(&cur->vm);
+	cur->mapid = 0;
+	list_init(&cur->mmap_list);
+
+  cur->pagedir = pagedir_create ();
+  if (cur->pagedir == NULL)
+    goto fail;
+  process_activate ();
+
+  cur->run_file = file_reopen (parent->run_file);
+  if (cur->run_file == NULL)
+    goto fail;
+  file_deny_write (cur->run_file);
+
+	/* share every page copy-on-write */
+	if(!vm_copy(&cur->vm, &parent->vm, cur->run_file))
+		goto fail;
+	cur->stack_bottom = parent->stack_bottom;
+	cur->stack_grow = parent->stack_grow;
+
+	/* each open file gets its own handle at the parent's position */
+	cur->fd_count = parent->fd_count;
+	for(i = 2; i < parent->fd_count; i++)
+	{
+		if(parent->fd_table[i] == NULL)
+			continue;
+		cur->fd_table[i] = file_reopen(parent->fd_table[i]);
+		if(cur->fd_table[i] == NULL)
+			goto fail;
+		file_seek(cur->fd_table[i], file_tell(parent->fd_table[i]));
+	}
+
+  cur->load_succeed = 1;
+  sema_up (&cur->sema_load);
+
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+
+ fail:
+  sema_up (&cur->sema_load);
+  thread_exit ();
+}
+
+static void argument_stack(char **parse, int count, void **esp) 
 {
    int i,j;
    int *save_addr;
@@ -158,7 +242,7 @@ void argument_stack(char **parse, int count, void **esp)
    {
      *esp = *esp - 1;
      diff_esp++;
-     **(char**)esp = NULL;
+     **(char**)esp = '\0';
    }
    *esp = *esp - 4;
    *(int*)(*esp) = 0;
@@ -216,12 +300,15 @@ process_exit (void)
   for(i = 2; i < cur->fd_count; i++)         /* close all file */
     process_close_file(i);
   
-  /* Destroy the current process's page directory and switch back
-     to the kernel-only page directory. */
-  file_close(cur->run_file);
-  palloc_free_page(cur->fd_table);
+  /* drop the mappings, shared text frames included, before the
+     executable they were read from is closed */
 	munmap(-1);
   vm_destroy(&cur->vm);
+  file_close(cur->run_file);
+  palloc_free_page(cur->fd_table);
+
+  /* Destroy the current process's page directory and switch back
+     to the kernel-only page directory. */
   pd = cur->pagedir;
   if (pd != NULL) 
     {
@@ -344,18 +431,15 @@ load (const char *file_name, void (**eip) (void), void **esp)
     goto done;
   process_activate ();
 
-  lock_acquire(&filesys_lock);
   /* Open executable file. */
   file = filesys_open (file_name);
   if (file == NULL) 
     {
-      lock_release(&filesys_lock);
       printf ("load: %s: open failed\n", file_name);
       goto done; 
     }
 	t->run_file = file;
   file_deny_write(file);
-  lock_release(&filesys_lock);
 
   /* Read and verify executable header. */
   if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
@@ -446,8 +530,6 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
 /* load() helpers. */
 
-static bool install_page (void *upage, void *kpage, bool writable);
-
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
 static bool
@@ -538,31 +620,14 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 			vme->writable = writable;	
 			vme->vaddr = upage;
 			vme->is_loaded = false; 
+			vme->pinned = false;
+			vme->advice = MADV_NORMAL;
+			vme->thread = thread_current();
+			vme->page = NULL;
 			
 			if(!insert_vme(&thread_current()->vm,vme))
 				return false;
 
-			/* 
-      // Get a page of memory. 
-      uint8_t *kpage = palloc_get_page (PAL_USER);
-      if (kpage == NULL)
-        return false;
-
-      // Load this page. 
-      if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
-        {
-          palloc_free_page (kpage);
-          return false; 
-        }
-      memset (kpage + page_read_bytes, 0, page_zero_bytes);
-
-      // Add the page to the process's address space. 
-      if (!install_page (upage, kpage, writable)) 
-        {
-          palloc_free_page (kpage);
-          return false; 
-        }
-			*/
       /* Advance. */
       read_bytes -= page_read_bytes;
       zero_bytes -= page_zero_bytes;
@@ -577,66 +642,91 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp) 
 {
-  void *kaddr;
   bool success = false;
-/*
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-  if (kpage != NULL) 
-    {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success)
-        *esp = PHYS_BASE;
-      else
-        palloc_free_page (kpage);
-    }
-*/
+	struct thread *t = thread_current();
+
+	t->stack_bottom = ((uint8_t *) PHYS_BASE) - PGSIZE;
+	t->stack_grow = 0;
+
+	success = add_stack_page(t->stack_bottom, true);
+  if (success)
+  	*esp = PHYS_BASE;
+  return success;
+}
+
+/* add a zero-filled stack page at UPAGE to the current process,
+   giving it a frame right away if MAP, or on first access if not */
+static bool add_stack_page(void *upage, bool map)
+{
 	struct vm_entry *vme = (struct vm_entry*)malloc(sizeof(struct vm_entry));
+	struct page *page;
+
 	if(vme == NULL)
 		return false;
 
-	
-	/* set vm_entry members  */
 	vme->type = VM_ANON;
-	vme->vaddr = ((uint8_t *) PHYS_BASE) - PGSIZE;
+	vme->vaddr = upage;
 	vme->writable = true;
-	vme->is_loaded = true;
-	
-	/* create new page */
-	struct page *page = alloc_page(PAL_USER | PAL_ZERO);
-	page->vme = vme; //set vme into page
-	kaddr = page->kaddr; // set kaddr
+	vme->is_loaded = false;
+	vme->pinned = false;
+	vme->advice = MADV_NORMAL;
+	vme->swap_slot = BITMAP_ERROR;
+	vme->thread = thread_current();
+	vme->page = NULL;
+
+	if(!insert_vme(&thread_current()->vm, vme))
+	{
+		free(vme);
+		return false;
+	}
+	if(!map)
+		return true;
 
-	/* insert vm_entry on hash_entry */
-	if(!insert_vme(&thread_current()->vm,vme)) //if inserting fail
-			return false;
-		
-	success = install_page(((uint8_t *) PHYS_BASE) - PGSIZE, kaddr, true);
-  if (success)
-  	*esp = PHYS_BASE;
-  else
-  	free_page(page);
-	
-  return success;
+	page = alloc_page(PAL_USER | PAL_ZERO);
+	if(page == NULL)
+		return false;
+	if(!map_page(page, vme))
+	{
+		__free_page(page);
+		return false;
+	}
+	return true;
 }
 
-/* Adds a mapping from user virtual address UPAGE to kernel
-   virtual address KPAGE to the page table.
-   If WRITABLE is true, the user process may modify the page;
-   otherwise, it is read-only.
-   UPAGE must not already be mapped.
-   KPAGE should probably be a page obtained from the user pool
-   with palloc_get_page().
-   Returns true on success, false if UPAGE is already mapped or
-   if memory allocation fails. */
-static bool
-install_page (void *upage, void *kpage, bool writable)
+/* grow the current process's stack down to ADDR, which faulted.
+   Pages between ADDR and the old bottom are added to be filled on
+   first access, and ADDR's page is mapped at once.  While faults
+   walk down the stack a page at a time, as in deep recursion, each
+   growth also maps twice as many pages below ADDR as the last, up
+   to STACK_GROW_MAX, so most of them take no fault at all.
+   Returns false if ADDR is not within stack_max of PHYS_BASE */
+bool expand_stack(void *addr)
 {
-  struct thread *t = thread_current ();
+	struct thread *t = thread_current();
+	uint8_t *upage = pg_round_down(addr);
+	uint8_t *limit = (uint8_t *) PHYS_BASE - ROUND_UP(stack_max, PGSIZE);
+	uint8_t *bottom, *p;
 
-  /* Verify that there's not already a page at that virtual
-     address, then map our page there. */
-  return (pagedir_get_page (t->pagedir, upage) == NULL
-          && pagedir_set_page (t->pagedir, upage, kpage, writable));
+	if(upage < limit || upage >= t->stack_bottom)
+		return false;
+
+	if(upage == t->stack_bottom - PGSIZE)
+		t->stack_grow = t->stack_grow == 0 ? 1
+		              : t->stack_grow * 2 < STACK_GROW_MAX ? t->stack_grow * 2 : STACK_GROW_MAX;
+	else
+		t->stack_grow = 0;
+
+	bottom = upage - t->stack_grow * PGSIZE;
+	if(bottom < limit)
+		bottom = limit;
+
+	for(p = t->stack_bottom - PGSIZE; p >= bottom; p -= PGSIZE)
+	{
+		if(!add_stack_page(p, p <= upage))
+			return false;
+		t->stack_bottom = p;
+	}
+	return true;
 }
 struct thread* get_child_process(int pid) 
 {
@@ -681,7 +771,7 @@ void process_close_file(int fd)
 {
   struct thread *t = thread_current();
   if(fd < 2 || t->fd_count <= fd)
-    return NULL;
+    return;
   file_close(t->fd_table[fd]);
   t->fd_table[fd] = NULL;
   
@@ -689,44 +779,60 @@ void process_close_file(int fd)
 
 bool handle_mm_fault(struct vm_entry * vme)
 {
+	/* the page may be unmapped because it is being evicted */
+	wait_on_page(vme);
 	if(vme->is_loaded)
 		return false; 
 
+	/* read-only text may already be in memory for another process */
+	bool shared = vme->type == VM_BIN && !vme->writable;
+	if(shared && map_shared_page(vme))
+	{
+		load_around(vme);
+		return true;
+	}
+
 	//void* kaddr = palloc_get_page(PAL_USER);
 	/* allocate memory */
 	struct page *page = alloc_page(PAL_USER);
-	page -> vme = vme;
-	void *kaddr = page -> kaddr;
-	if(!kaddr)
+	if(page == NULL)
 		return false;
+	void *kaddr = page -> kaddr;
 
 	switch(vme->type)
 	{
 		case VM_BIN :
+		case VM_FILE :
 			if(!load_file(kaddr,vme)) 
 			{
-				free_page(kaddr);				
+				__free_page(page);
 				return false;			
 			}
+			count_page_in(false);
 			break;
 
-		case VM_FILE :
-			if(!load_file(kaddr,vme))
-			{
-				free_page(kaddr);
-				return false;
-			}
-			break;	
-
 		case VM_ANON:
-			swap_in(vme->swap_slot, kaddr);
+			/* a stack page never written out is zero-filled */
+			if(vme->swap_slot == BITMAP_ERROR)
+				memset(kaddr, 0, PGSIZE);
+			else
+				swap_in_around(vme, kaddr);
 		break;
 	}
-		
-	if(!install_page(vme->vaddr, kaddr, vme->writable))
+
+	if(shared)
+	{
+		if(!map_new_shared_page(page, vme))
+			return false;
+	}
+	else if(!map_page(page, vme))
+	{
+		__free_page(page);
 		return false;
+	}
 
-	vme->is_loaded = true;
+	if(vme->type != VM_ANON)
+		load_around(vme);
 	return true;	
 	
 }
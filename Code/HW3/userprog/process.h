@@ -1,12 +1,25 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include "threads/interrupt.h"
 #include "threads/thread.h"
 
+/* most pages a single stack growth maps ahead of the fault */
+#define STACK_GROW_MAX 8
+
+extern size_t stack_max;
+
 tid_t process_execute (const char *file_name);
+tid_t process_fork (struct intr_frame *f);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
 bool expand_stack(void *addr);
 
+struct thread* get_child_process(int pid);
+void remove_child_process(struct thread *cp);
+int process_add_file(struct file *f);
+struct file* process_get_file(int fd);
+void process_close_file(int fd);
+
 #endif /* userprog/process.h */
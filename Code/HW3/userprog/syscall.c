@@ -14,14 +14,21 @@
 #include "threads/vaddr.h"
 #include "vm/frame.h"
 #include "vm/swap.h"
+#include "threads/palloc.h"
+#include "threads/malloc.h"
+#include "userprog/uaccess.h"
+
+/* reads up to this size go through a buffer on the kernel stack
+   instead of a page */
+#define READ_STACK_BUF 128
 
 static void syscall_handler (struct intr_frame *);
 
-struct vm_entry* check_address(void *addr, void *esp);
 void get_argument(void *esp, int *arg, int count);
 void halt(void);
 void exit(int status);
 tid_t exec(const char *cmd_line);
+tid_t sys_fork(struct intr_frame *f);
 int wait(tid_t tid);
 bool create(const char *file, unsigned int initial_size);
 bool remove(const char* file);
@@ -32,87 +39,111 @@ int write(int fd, char *buffer, unsigned size);
 void seek(int fd, unsigned int position);
 unsigned int tell(int fd);
 void close(int fd);
+int mmap(int fd, void *addr);
+void do_munmap(struct mmap_file *mmap_f);
 
 void
 syscall_init (void){
 
-	lock_init(&filesys_lock);
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 
 }
-/* check address */
-struct vm_entry* check_address(void *addr, void *esp UNUSED)
+/* pin the page of addr and fault it in, so try_to_free_pages()
+   cannot evict it while the kernel copies into it */
+static struct vm_entry* pin_address(void *addr)
 {
-	/*check address 0x08048000 ~ 0xc0000000 */ 
-	bool loaded = false;
+	struct vm_entry *vme;
+	bool loaded;
 
-	if((unsigned int*)(addr) <= (unsigned int)(0x08048000) || (unsigned int*)addr >= (unsigned int)(0xc0000000))
-  {
+	if((unsigned int)addr <= (unsigned int)0x08048000 || (unsigned int)addr >= (unsigned int)0xc0000000)
 		exit(-1);
-	}
-	struct vm_entry* vme = find_vme(addr);
 
-	if(vme)
-	{
-		handle_mm_fault(vme);
-		loaded = vme->is_loaded;	
-	}
-	if(vme != NULL && loaded == false)
+	vme = find_vme(addr);
+
+	/* a buffer on the stack just below what has been touched */
+	if(vme == NULL && addr >= thread_current()->user_esp - 32 && expand_stack(addr))
+		vme = find_vme(addr);
+	if(vme == NULL)
+		exit(-1);
+
+	loaded = pin_page(vme);
+
+	if(!loaded && !handle_mm_fault(vme))
 		exit(-1);
 
 	return vme;
 }
 
-void check_valid_buffer(void *buffer, unsigned size, void *esp, bool to_write) 
+/* check buffer one page at a time, not one byte at a time */
+void check_valid_buffer(void *buffer, unsigned size)
 {
-	struct vm_entry *vme;
-	unsigned int i;
+	void *addr;
+	void *last;
+
+	if(size == 0)
+		return;
 
-	for(i=0; i<size; i++)
+	last = pg_round_down(buffer + size - 1);
+	if(last < pg_round_down(buffer)) 	/* buffer wraps around address space */
+		exit(-1);
+
+	for(addr = buffer; ; addr = pg_round_down(addr) + PGSIZE)
 	{
-		vme	= check_address(buffer,esp);
-		
-		if(vme == NULL)
-			exit(-1);
-	
-		if(to_write && vme->writable == false)
-			exit(-1);
-		
-		buffer += 1;
-	} 
+		pin_address(addr);
+
+		if(pg_round_down(addr) == last)
+			break;
+	}
 }
 
-void check_valid_string(const void *str, void *esp) 
+/* release pages pinned by check_valid_buffer */
+void unpin_buffer(void *buffer, unsigned size)
 {
 	struct vm_entry *vme;
-	unsigned int i;
-	unsigned int length;
+	void *addr;
+	void *last;
 
-	vme = check_address(str,esp);
-	if(vme == NULL)
+	if(size == 0)
+		return;
+
+	last = pg_round_down(buffer + size - 1);
+	for(addr = buffer; ; addr = pg_round_down(addr) + PGSIZE)
+	{
+		vme = find_vme(addr);
+		if(vme != NULL)
+			unpin_page(vme);
+
+		if(pg_round_down(addr) == last)
+			break;
+	}
+}
+
+/* copy a user string into a new kernel page, the caller frees it.
+   A string that does not fit in the page kills the process rather
+   than being cut short */
+static char* get_user_string(const char *ustr)
+{
+	char *kstr = palloc_get_page(0);
+	int len;
+
+	if(kstr == NULL)
 		exit(-1);
 
-	length = strlen((char*)str);
-	
-	for(i=0; i<length; i++)
+	len = strncpy_from_user(kstr, ustr, PGSIZE);
+	if(len < 0 || len >= PGSIZE)
 	{
-		vme = check_address(str,esp);
-		if(vme == NULL)
-			exit(-1);
+		palloc_free_page(kstr);
+		exit(-1);
 	}
 
+	return kstr;
 }
 
-
 /* get argument */
 void get_argument(void *esp, int *arg, int count)
 {
-	int i;
-	for(i = 0; i < count; i++){
-		check_address(esp,esp);
-		arg[i] = *(int*)esp;
-		esp = esp + 4;
-	}
+	if(copy_from_user(arg, esp, sizeof(int) * count) != 0)
+		exit(-1);
 }
 
 int mmap(int fd, void *addr) 
@@ -176,6 +207,10 @@ int mmap(int fd, void *addr)
 		vme->type = VM_FILE;
 		vme->writable = true;
 		vme->is_loaded = false;
+		vme->pinned = false;
+		vme->advice = MADV_NORMAL;
+		vme->thread = thread_current();
+		vme->page = NULL;
 
 		/* insert entry into vme_list */
 		list_push_back(&file->vme_list, &vme->mmap_elem);
@@ -217,11 +252,7 @@ munmap(int mapping)
 
 			/* close file */
 			if(mmap_fp->file != NULL)
-			{
-				lock_acquire(&filesys_lock);
 				file_close(mmap_fp->file);
-				lock_release(&filesys_lock);
-			}
 
 			list_remove(&mmap_fp -> elem);
 			free(mmap_fp);
@@ -248,17 +279,11 @@ do_munmap(struct mmap_file *mmap_f){
 
 		if(vme != NULL && vme -> is_loaded)
 		{
-			if(pagedir_is_dirty(thread_current()->pagedir, vme->vaddr))
-			{
-				lock_acquire(&filesys_lock);
-				file_write_at(vme->file, vme->vaddr, vme->read_bytes, vme->offset);
-				lock_release(&filesys_lock);
-			}
+			sync_page(vme);
 
 			/* clear page allocated for vm entry */
 //			palloc_free_page(pagedir_get_page(thread_current() -> pagedir, c_entry -> vaddr));
-			free_page(pagedir_get_page(thread_current()->pagedir, vme->vaddr));
-			pagedir_clear_page(thread_current()->pagedir, vme->vaddr);
+			unmap_page(vme);
 		}
 
 		/* remvoe from mmap list */
@@ -270,15 +295,80 @@ do_munmap(struct mmap_file *mmap_f){
 	}
 }
 
+/* find the current process's mapping MAPID */
+static struct mmap_file *find_mmap(int mapid)
+{
+	struct list *mmap_list = &thread_current()->mmap_list;
+	struct list_elem *e;
+
+	for(e = list_begin(mmap_list); e != list_end(mmap_list); e = list_next(e))
+	{
+		struct mmap_file *mmap_f = list_entry(e, struct mmap_file, elem);
+		if(mmap_f->mapid == mapid)
+			return mmap_f;
+	}
+	return NULL;
+}
+
+/* write the dirty pages of mapping MAPID back to its file, keeping
+   them mapped */
+static int msync(int mapid)
+{
+	struct mmap_file *mmap_f = find_mmap(mapid);
+	struct list_elem *e;
+
+	if(mmap_f == NULL)
+		return -1;
+
+	for(e = list_begin(&mmap_f->vme_list); e != list_end(&mmap_f->vme_list); e = list_next(e))
+		sync_page(list_entry(e, struct vm_entry, mmap_elem));
+	return 0;
+}
+
+/* apply ADVICE, one of the MADV_* values, to mapping MAPID.
+   MADV_WILLNEED reads in the pages that fit in free frames now and
+   MADV_DONTNEED writes back and drops the pages in memory; the
+   others change how later faults read ahead, see load_around() */
+static int madvise(int mapid, int advice)
+{
+	struct mmap_file *mmap_f = find_mmap(mapid);
+	struct list_elem *e;
+
+	if(mmap_f == NULL || advice < MADV_NORMAL || advice > MADV_DONTNEED)
+		return -1;
+
+	for(e = list_begin(&mmap_f->vme_list); e != list_end(&mmap_f->vme_list); e = list_next(e))
+	{
+		struct vm_entry *vme = list_entry(e, struct vm_entry, mmap_elem);
+
+		if(advice == MADV_WILLNEED)
+		{
+			if(!vme->is_loaded && !prefetch_page(vme))
+				break;
+		}
+		else if(advice == MADV_DONTNEED)
+		{
+			sync_page(vme);
+			unmap_page(vme);
+		}
+		else
+			vme->advice = advice;
+	}
+	return 0;
+}
+
 static void
 syscall_handler (struct intr_frame *f UNUSED)
 {
 	void *esp = (void*)(f->esp);
+
+	/* faults on user memory in the kernel use this to grow the stack */
+	thread_current()->user_esp = esp;
 	int arg[3];
-	check_address(esp,esp);
-	int sys_call_number = *(int*)esp;
+	int sys_call_number;
+	if(copy_from_user(&sys_call_number, esp, sizeof sys_call_number) != 0)
+		exit(-1);
 	esp = esp + 4;
-	check_address(esp,esp);
 	switch(sys_call_number)
   {
 		case SYS_HALT:
@@ -297,13 +387,16 @@ syscall_handler (struct intr_frame *f UNUSED)
 			{
 				get_argument(esp, arg, 1); 
 				char *exec_cmd_line;
-				exec_cmd_line = (char*)(arg[0]);
-        //check_address(exec_cmd_line);
-				check_valid_string(exec_cmd_line,esp);
+				exec_cmd_line = get_user_string((char*)(arg[0]));
 				f->eax = exec(exec_cmd_line);
+				palloc_free_page(exec_cmd_line);
 			}
 			break;
 
+		case SYS_FORK:
+			f->eax = sys_fork(f);
+			break;
+
 		case SYS_WAIT:
 			{
 				get_argument(esp, arg, 1);
@@ -316,12 +409,11 @@ syscall_handler (struct intr_frame *f UNUSED)
 			{			
 				get_argument(esp, arg, 2); 
 				char *create_file_name;
-				create_file_name  = (char*)(arg[0]);
+				create_file_name = get_user_string((char*)(arg[0]));
 				unsigned int create_initial_size;
 				create_initial_size = (unsigned int)(arg[1]);
-				//check_address(create_file_name);
-				check_valid_string(create_file_name,esp);				
 				f->eax = create(create_file_name, create_initial_size);
+				palloc_free_page(create_file_name);
 			}
 			break;
 
@@ -329,10 +421,9 @@ syscall_handler (struct intr_frame *f UNUSED)
 			{	
 				get_argument(esp, arg, 1); 
 				char *remove_file_name;
-				remove_file_name = (char*)(arg[0]);
-				//check_address(remove_file_name);
-				check_valid_string(remove_file_name,esp);				
+				remove_file_name = get_user_string((char*)(arg[0]));
 				f->eax = remove(remove_file_name);
+				palloc_free_page(remove_file_name);
 			}
 			break;
 
@@ -340,10 +431,9 @@ syscall_handler (struct intr_frame *f UNUSED)
 			{
 				get_argument(esp, arg, 1);
 				char *open_file_name;		
-				open_file_name = (char*)(arg[0]);
-        //check_address(open_file_name);
-				check_valid_string(open_file_name,esp);
+				open_file_name = get_user_string((char*)(arg[0]));
 				f->eax = open(open_file_name);
+				palloc_free_page(open_file_name);
 			}
 			break;
 
@@ -367,8 +457,6 @@ syscall_handler (struct intr_frame *f UNUSED)
 				buffer = (char*)arg[1];
 				size = (unsigned)(arg[2]); 
 				
-				//check_address((void*)buffer);
-				check_valid_buffer((void*)buffer,size,esp,false);				
 				f->eax = read(fd, buffer, size);
 			}
 			break;
@@ -385,9 +473,9 @@ syscall_handler (struct intr_frame *f UNUSED)
 				buffer = (char*)arg[1];	
 				size = (unsigned)arg[2]; 
 
-				//check_address((void*)buffer);
-				check_valid_buffer((void*)buffer,size,esp,false);        
+				check_valid_buffer((void*)buffer,size);
 				f->eax = write(fd, buffer, size);
+				unpin_buffer((void*)buffer,size);
 			}
 			break;
 
@@ -418,7 +506,7 @@ syscall_handler (struct intr_frame *f UNUSED)
 
 		case SYS_CLOSE:
 			{
-				get_argument(esp, arg, 2);		
+				get_argument(esp, arg, 1);		
 				int fd;
 				fd = arg[0];
 				close(fd);
@@ -442,6 +530,16 @@ syscall_handler (struct intr_frame *f UNUSED)
 				munmap(mapping);
 			}
 			break;
+
+		case SYS_MSYNC:
+			get_argument(esp, arg, 1);
+			f->eax = msync(arg[0]);
+			break;
+
+		case SYS_MADVISE:
+			get_argument(esp, arg, 2);
+			f->eax = madvise(arg[0], arg[1]);
+			break;
 	}		
 
 }
@@ -478,6 +576,21 @@ tid_t exec(const char *cmd_line)
 }
 
 
+/* make child process, a copy of the current one */
+tid_t sys_fork(struct intr_frame *f)
+{
+	tid_t tid = process_fork(f);
+	struct thread *child = get_child_process(tid);
+	if(child)
+	{
+		sema_down(&child->sema_load);
+		if(child->load_succeed)
+			return tid;
+	}
+	return -1;
+}
+
+
 /* wait proces */
 int wait(tid_t tid)
 {
@@ -524,56 +637,82 @@ int filesize(int fd)
 	return file_size;
 }
 
-/* read data on open_file */
+/* read data on open_file.  Data goes through a kernel buffer and
+   copy_to_user(), so a bad buffer faults in the copy and kills the
+   process instead of having to be checked and pinned up front.
+   short reads use a buffer on the stack, longer ones a page */
 int read(int fd, char *buffer, unsigned size)
 {
-	lock_acquire(&filesys_lock); 
-	if(fd == 0)
-  {
-		unsigned int i;
-		for(i = 0; i < size; i++)
-			buffer[i] = input_getc();
-		
-		lock_release(&filesys_lock);
+	struct file *read_file = NULL;
+	unsigned read_bytes = 0;
+	char stack_buf[READ_STACK_BUF];
+	char *kbuf = stack_buf;
+	unsigned kbuf_size = sizeof stack_buf;
 
-		return size;
+	if(fd != 0)
+	{
+		read_file = process_get_file(fd); 
+		if(!read_file)
+			return -1;
 	}
 
-	struct file *read_file = process_get_file(fd); 
-	
-	if(!read_file)
-  {
-		lock_release(&filesys_lock);
-		return -1;
+	if(size > kbuf_size)
+	{
+		kbuf = palloc_get_page(0);
+		if(kbuf == NULL)
+			return -1;
+		kbuf_size = PGSIZE;
+	}
+
+	while(read_bytes < size)
+	{
+		unsigned chunk = size - read_bytes < kbuf_size ? size - read_bytes : kbuf_size;
+		unsigned i;
+		int n;
+
+		if(fd == 0)
+		{
+			for(i = 0; i < chunk; i++)
+				kbuf[i] = input_getc();
+			n = chunk;
+		}
+		else
+			n = file_read(read_file, kbuf, chunk);
+
+		if(n > 0 && copy_to_user(buffer + read_bytes, kbuf, n) != 0)
+		{
+			if(kbuf != stack_buf)
+				palloc_free_page(kbuf);
+			exit(-1);
+		}
+		if(n <= 0)
+			break;
+		read_bytes += n;
+		if((unsigned)n < chunk)
+			break;
 	}
-	int read_bytes = file_read(read_file, buffer, size);
-	lock_release(&filesys_lock); 
 
+	if(kbuf != stack_buf)
+		palloc_free_page(kbuf);
 	return read_bytes;
 }
 
 /* write data on open_file */
 int write(int fd, char *buffer, unsigned size)
 {
-	lock_acquire(&filesys_lock); 
-
 	if(fd == 1)
   { 
 		putbuf(buffer,size);
-		lock_release(&filesys_lock); 
 		return size;
 	}
 
 	struct file *write_file = process_get_file(fd); 
 
 	if(!write_file)
-  {
-		lock_release(&filesys_lock);
 		return -1;
-	}
 
+	/* inode_write_at() takes the inode's own lock */
 	int write_bytes = file_write(write_file, buffer, size);
-	lock_release(&filesys_lock); 
 	
   return write_bytes;
 }
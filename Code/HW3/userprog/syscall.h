@@ -2,7 +2,7 @@
 #define USERPROG_SYSCALL_H
 
 void syscall_init (void);
-
-struct lock filesys_lock; //add to use filesystem lock
+void exit (int status);
+void munmap (int mapping);
 
 #endif /* userprog/syscall.h */
@@ -0,0 +1,128 @@
+#include "userprog/uaccess.h"
+#include <debug.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/vaddr.h"
+
+/* Exception table entry.  INSN is the address of an instruction
+   allowed to fault on a user address, FIXUP is where execution
+   resumes if it does.  The linker script gathers all entries
+   between _start_ex_table and _end_ex_table. */
+struct ex_table_entry
+  {
+    uint32_t insn;
+    uint32_t fixup;
+  };
+
+extern const struct ex_table_entry _start_ex_table[], _end_ex_table[];
+
+/* Emits an exception table entry for the instruction at label
+   INSN, resuming at label FIXUP.  page_fault() sets %eax to -1
+   before jumping to FIXUP, so every asm statement using this must
+   have %eax as an output or a clobber. */
+#define EX_TABLE_ENTRY(INSN, FIXUP)             \
+        ".section __ex_table, \"a\"\n"          \
+        "  .long " INSN ", " FIXUP "\n"         \
+        ".previous\n"
+
+/* Returns true if SIZE bytes starting at UADDR lie entirely in
+   user virtual memory. */
+static inline bool
+is_user_range (const void *uaddr, size_t size)
+{
+  return (uintptr_t) uaddr + size >= (uintptr_t) uaddr
+         && (uintptr_t) uaddr + size <= (uintptr_t) PHYS_BASE;
+}
+
+/* Reads a byte at user virtual address UADDR.
+   Returns the byte value if successful, -1 if a fault
+   occurred. */
+static inline int
+get_user (const uint8_t *uaddr)
+{
+  int result;
+  asm volatile ("1: movzbl %1, %0\n"
+                "2:\n"
+                EX_TABLE_ENTRY ("1b", "2b")
+                : "=&a" (result) : "m" (*uaddr));
+  return result;
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address
+   DST.  Returns the number of bytes that could not be copied,
+   so 0 means success. */
+size_t
+copy_from_user (void *dst, const void *usrc, size_t size)
+{
+  if (!is_user_range (usrc, size))
+    return size;
+
+  asm volatile ("1: rep movsb\n"
+                "2:\n"
+                EX_TABLE_ENTRY ("1b", "2b")
+                : "+c" (size), "+D" (dst), "+S" (usrc)
+                : : "eax", "memory");
+  return size;
+}
+
+/* Copies SIZE bytes from kernel address SRC to user address
+   UDST.  Returns the number of bytes that could not be copied,
+   so 0 means success. */
+size_t
+copy_to_user (void *udst, const void *src, size_t size)
+{
+  if (!is_user_range (udst, size))
+    return size;
+
+  asm volatile ("1: rep movsb\n"
+                "2:\n"
+                EX_TABLE_ENTRY ("1b", "2b")
+                : "+c" (size), "+D" (udst), "+S" (src)
+                : : "eax", "memory");
+  return size;
+}
+
+/* Copies a null-terminated string from user address USRC to
+   DST, copying at most SIZE bytes including the null terminator.
+   Returns the length of the string, SIZE if it did not fit (DST
+   is then not terminated), or -1 if USRC is a bad pointer. */
+int
+strncpy_from_user (char *dst, const char *usrc, size_t size)
+{
+  const uint8_t *uaddr = (const uint8_t *) usrc;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    {
+      int c;
+
+      if (!is_user_vaddr (uaddr + i))
+        return -1;
+      c = get_user (uaddr + i);
+      if (c == -1)
+        return -1;
+      dst[i] = c;
+      if (c == '\0')
+        return i;
+    }
+  return size;
+}
+
+/* Called by page_fault() for a fault in kernel mode that could
+   not be resolved.  If the faulting instruction has an exception
+   table entry, redirects F to its fixup address with %eax set to
+   -1 and returns true.  Otherwise returns false. */
+bool
+fixup_exception (struct intr_frame *f)
+{
+  const struct ex_table_entry *e;
+
+  for (e = _start_ex_table; e < _end_ex_table; e++)
+    if (e->insn == (uint32_t) f->eip)
+      {
+        f->eip = (void (*) (void)) e->fixup;
+        f->eax = 0xffffffff;
+        return true;
+      }
+  return false;
+}
@@ -0,0 +1,23 @@
+#ifndef USERPROG_UACCESS_H
+#define USERPROG_UACCESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Copying between kernel and user memory.
+
+   These routines do not check user pointers up front.  They
+   just perform the access; if it faults on a page that cannot be
+   brought in, page_fault() finds the faulting instruction in the
+   exception table and resumes at its fixup address, and the
+   routine reports failure to its caller. */
+
+struct intr_frame;
+
+size_t copy_from_user (void *dst, const void *usrc, size_t size);
+size_t copy_to_user (void *udst, const void *src, size_t size);
+int strncpy_from_user (char *dst, const char *usrc, size_t size);
+
+bool fixup_exception (struct intr_frame *);
+
+#endif /* userprog/uaccess.h */
@@ -1,14 +1,92 @@
+#include <stdio.h>
+#include <string.h>
 #include "filesys/file.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "userprog/pagedir.h"
 #include "userprog/syscall.h"
 #include "vm/frame.h"
 #include "vm/page.h"
 #include "vm/swap.h"
 
+/* read-only text frames, keyed by (inode sector, offset, read_bytes), so
+   processes running the same executable share them.  The sector, unlike
+   the struct inode address, cannot be reused while the frames exist */
+static struct hash shared_pages;
+
+/* one descriptor per frame of the user pool, indexed by kernel
+   address; kaddr is NULL while the frame is free.  Guarded by
+   lru_list_lock */
+static struct page *frame_table;
+static uint8_t *frame_base;
+static size_t frame_cnt;
+
+/* frame of zeros mapped read-only for pages nobody has written yet,
+   BSS and fresh stack, until their first write copies it.  It is
+   never on lru_list and never freed */
+static struct page *zero_page;
+
+/* two-handed clock over lru_list.  The front hand clears accessed
+   bits and lru_clock, the back hand, follows a quarter of the list
+   behind it and evicts frames nobody used in between */
+static struct list_elem *front_hand;
+
+/* the page-out daemon is woken when fewer than low_water frames
+   are free and reclaims frames until high_water are free, so that
+   faults rarely have to wait for a victim to be written */
+static size_t low_water, high_water;
+static struct semaphore pageout_sema;
+static bool pageout_wanted;
+
+/* most dirty file pages the daemon writes back per wakeup */
+#define PRECLEAN_MAX 8
+
+/* signalled, with lru_list_lock, whenever a busy page's I/O
+   finishes */
+static struct condition page_io_done;
+
+/* statistics */
+static int frames_in_use, frames_peak;
+static long long page_in_cnt, fault_around_cnt, shared_hit_cnt, evict_cnt, cow_cnt;
+static long long clean_evict_cnt, dirty_evict_cnt, preclean_cnt, sync_cnt, deactivate_cnt;
+static long long zero_map_cnt, zero_cow_cnt;
+static int zero_in_use, zero_peak;
+static long long direct_reclaim_cnt, background_reclaim_cnt, pageout_wakeup_cnt, alloc_stall_cnt;
+
+static struct page* new_page(void *kaddr);
+
+/* descriptor of user frame KADDR */
+static struct page *frame_lookup(void *kaddr)
+{
+	size_t idx = ((uint8_t *)kaddr - frame_base) / PGSIZE;
+
+	ASSERT(pg_ofs(kaddr) == 0);
+	ASSERT((uint8_t *)kaddr >= frame_base && idx < frame_cnt);
+	return &frame_table[idx];
+}
+
+static unsigned shared_hash_func(const struct hash_elem *e, void *aux UNUSED)
+{
+	struct page *page = hash_entry(e, struct page, share_elem);
+	return hash_int(page->inumber) ^ hash_int(page->offset);
+}
+
+static bool shared_less_func(const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED)
+{
+	struct page *pa = hash_entry(a, struct page, share_elem);
+	struct page *pb = hash_entry(b, struct page, share_elem);
+
+	if(pa->inumber != pb->inumber)
+		return pa->inumber < pb->inumber;
+	if(pa->offset != pb->offset)
+		return pa->offset < pb->offset;
+	return pa->read_bytes < pb->read_bytes;
+}
+
 struct list_elem* get_next_lru_clock(void)
 {
 	if(lru_clock == NULL)
@@ -25,64 +103,429 @@ struct list_elem* get_next_lru_clock(void)
 	return next_elem;
 }
 
-void* try_to_free_pages(enum palloc_flags flags)
+/* the element after E on lru_list, wrapping around */
+static struct list_elem *ring_next(struct list_elem *e)
 {
-	if(list_empty(&lru_list) == true)
+	struct list_elem *next = list_next(e);
+
+	return next != list_end(&lru_list) ? next : list_begin(&lru_list);
+}
+
+/* where a clock hand at HAND goes when PAGE leaves lru_list */
+static struct list_elem *hand_past(struct list_elem *hand, struct page *page)
+{
+	struct list_elem *next;
+
+	if(hand != &page->lru)
+		return hand;
+	next = ring_next(hand);
+	return next != hand ? next : NULL;
+}
+
+/* true if any process mapping PAGE has it pinned for syscall I/O */
+static bool page_pinned(struct page *page)
+{
+	struct list_elem *e;
+
+	for(e = list_begin(&page->vmes); e != list_end(&page->vmes); e = list_next(e))
+		if(list_entry(e, struct vm_entry, page_elem)->pinned)
+			return true;
+	return false;
+}
+
+/* true if any process accessed PAGE since the last check; clears
+   the accessed bits so the next pass of the clock can evict it */
+static bool page_accessed(struct page *page)
+{
+	struct list_elem *e;
+	bool accessed = false;
+
+	for(e = list_begin(&page->vmes); e != list_end(&page->vmes); e = list_next(e))
 	{
-		lru_clock = NULL;
-		return NULL;
+		struct vm_entry *vme = list_entry(e, struct vm_entry, page_elem);
+		if(pagedir_is_accessed(vme->thread->pagedir, vme->vaddr))
+		{
+			pagedir_set_accessed(vme->thread->pagedir, vme->vaddr, false);
+			accessed = true;
+		}
 	}
+	return accessed;
+}
+
+/* true if any process wrote to PAGE */
+static bool page_dirty(struct page *page)
+{
+	struct list_elem *e;
 
+	for(e = list_begin(&page->vmes); e != list_end(&page->vmes); e = list_next(e))
+	{
+		struct vm_entry *vme = list_entry(e, struct vm_entry, page_elem);
+		if(pagedir_is_dirty(vme->thread->pagedir, vme->vaddr))
+			return true;
+	}
+	return false;
+}
+
+/* wait until VME's frame, if it has one, is no longer busy.  The
+   frame may be gone, or a different one, when this returns.
+   lru_list_lock must be held */
+static void page_io_wait(struct vm_entry *vme)
+{
+	while(vme->page != NULL && vme->page->busy)
+		cond_wait(&page_io_done, &lru_list_lock);
+}
+
+/* mark PAGE busy for I/O and unmap it from every process, so a
+   write during the I/O faults and waits instead of being lost.
+   lru_list_lock must be held */
+static void page_isolate(struct page *page)
+{
+	struct list_elem *e;
+
+	page->busy = true;
+	for(e = list_begin(&page->vmes); e != list_end(&page->vmes); e = list_next(e))
+	{
+		struct vm_entry *vme = list_entry(e, struct vm_entry, page_elem);
+		pagedir_clear_page(vme->thread->pagedir, vme->vaddr);
+	}
+}
+
+/* map PAGE again after page_isolate(), its I/O abandoned.  The
+   dirty bits were lost with the mappings, so they are set again
+   to be safe.  lru_list_lock must be held */
+static void page_restore(struct page *page)
+{
+	struct list_elem *e;
+	bool writable = list_size(&page->vmes) == 1;
+
+	for(e = list_begin(&page->vmes); e != list_end(&page->vmes); e = list_next(e))
+	{
+		struct vm_entry *vme = list_entry(e, struct vm_entry, page_elem);
+		uint32_t *pd = vme->thread->pagedir;
+
+		pagedir_set_page(pd, vme->vaddr, page->kaddr, writable && vme->writable);
+		pagedir_set_dirty(pd, vme->vaddr, true);
+	}
+	page->busy = false;
+	cond_broadcast(&page_io_done, &lru_list_lock);
+}
+
+/* remove every mapping of PAGE and release the frame.
+   lru_list_lock must be held */
+static void page_release(struct page *page)
+{
+	while(!list_empty(&page->vmes))
+	{
+		struct vm_entry *vme = list_entry(list_pop_front(&page->vmes), struct vm_entry, page_elem);
+		pagedir_clear_page(vme->thread->pagedir, vme->vaddr);
+		vme->is_loaded = false;
+		vme->page = NULL;
+	}
+
+	if(page->busy)
+	{
+		page->busy = false;
+		cond_broadcast(&page_io_done, &lru_list_lock);
+	}
+
+	if(page->shared)
+		hash_delete(&shared_pages, &page->share_elem);
+	del_page_from_lru_list(page);
+	palloc_free_page(page->kaddr);
+	page->kaddr = NULL;
+	frames_in_use--;
+}
+
+/* true if PAGE can go to swap in the same cluster as a victim
+   of thread T: mapped only by T, not file-backed, not pinned, in
+   need of saving and not recently accessed */
+static bool cluster_candidate(struct page *page, struct thread *t)
+{
+	struct vm_entry *vme;
+
+	if(list_size(&page->vmes) != 1 || page->shared || page->busy)
+		return false;
+
+	vme = list_entry(list_front(&page->vmes), struct vm_entry, page_elem);
+	if(vme->thread != t || vme->pinned || vme->type == VM_FILE || vme->type == VM_ERROR)
+		return false;
+
+	/* a clean VM_BIN page is just dropped and read back from the file */
+	if(vme->type != VM_ANON && !page_dirty(page))
+		return false;
+
+	return !page_accessed(page);
+}
+
+/* swap out VICTIM together with the pages of the same process that
+   follow it on the LRU list, up to SWAP_CLUSTER of them, so they
+   take consecutive slots and go to disk in one block request.
+   Pages are allocated in the order a process touches them, so the
+   cluster is usually consecutive in its address space as well,
+   which swap_in_around() takes advantage of.  lru_list_lock is
+   released for the write */
+static size_t swap_out_pages(struct page *victim)
+{
+	struct vm_entry *vme = list_entry(list_front(&victim->vmes), struct vm_entry, page_elem);
+	struct page *pages[SWAP_CLUSTER];
+	void *kaddrs[SWAP_CLUSTER];
+	struct list_elem *e;
+	size_t cnt = 1, slot, i;
+
+	pages[0] = victim;
+	kaddrs[0] = victim->kaddr;
+	for(e = list_next(&victim->lru); cnt < SWAP_CLUSTER && e != list_end(&lru_list); e = list_next(e))
+	{
+		struct page *page = list_entry(e, struct page, lru);
+
+		if(!cluster_candidate(page, vme->thread))
+			break;
+		pages[cnt] = page;
+		kaddrs[cnt++] = page->kaddr;
+	}
+
+	for(i = 0; i < cnt; i++)
+		page_isolate(pages[i]);
+	lock_release(&lru_list_lock);
+
+	slot = swap_out_cluster(kaddrs, cnt);
+	if(slot == BITMAP_ERROR)
+	{
+		/* no run of free slots that long; the rest go back */
+		slot = swap_out(victim->kaddr);
+		lock_acquire(&lru_list_lock);
+		for(i = 1; i < cnt; i++)
+			page_restore(pages[i]);
+		cnt = 1;
+	}
+	else
+		lock_acquire(&lru_list_lock);
+
+	for(i = 0; i < cnt; i++)
+	{
+		/* every process sharing a frame shares its slot */
+		for(e = list_begin(&pages[i]->vmes); e != list_end(&pages[i]->vmes); e = list_next(e))
+		{
+			vme = list_entry(e, struct vm_entry, page_elem);
+			vme->type = VM_ANON;
+			vme->swap_slot = slot + i;
+			if(e != list_begin(&pages[i]->vmes))
+				swap_share(slot + i);
+		}
+		page_release(pages[i]);
+	}
+	evict_cnt += cnt;
+	dirty_evict_cnt += cnt;
+	return cnt;
+}
+
+/* true if PAGE must be saved before its frame is reused.  Shared
+   text is never written, so only a private page, or one still
+   shared copy-on-write after fork, needs it */
+static bool page_needs_write(struct page *page)
+{
+	struct vm_entry *vme = list_entry(list_front(&page->vmes), struct vm_entry, page_elem);
+
+	if(vme->type == VM_ERROR)
+		return false;
+	return vme->type == VM_ANON || page_dirty(page);
+}
+
+/* evict PAGE, saving it first if needed, with lru_list_lock
+   released for the write.  Returns the number of frames freed */
+static size_t evict_page(struct page *page)
+{
+	struct vm_entry *vme = list_entry(list_front(&page->vmes), struct vm_entry, page_elem);
+
+	if(!page_needs_write(page))
+		clean_evict_cnt++;
+	else if(vme->type == VM_FILE)
+	{
+		struct file *file = vme->file;
+		off_t ofs = vme->offset;
+		size_t bytes = vme->read_bytes;
+
+		page_isolate(page);
+		lock_release(&lru_list_lock);
+		file_write_at(file, page->kaddr, bytes, ofs);
+		lock_acquire(&lru_list_lock);
+		dirty_evict_cnt++;
+	}
+	else
+		return swap_out_pages(page);
+
+	page_release(page);
+	evict_cnt++;
+	return 1;
+}
+
+/* run the clock until it finds a victim and evict it.  A clean
+   victim is taken at once; a dirty one only if a whole sweep finds
+   nothing clean.  BACKGROUND reclaim never takes a page that needs
+   swap when there is no swap disk.  Returns the number of frames
+   freed; lru_list_lock must be held, and is released while a
+   dirty victim is written */
+static size_t reclaim_pages(bool background)
+{
+	struct page *dirty = NULL;
+	size_t size, step;
+
+	if(list_empty(&lru_list))
+	{
+		lru_clock = front_hand = NULL;
+		return 0;
+	}
+
+	size = list_size(&lru_list);
 	if(lru_clock == NULL)
 		lru_clock = list_begin(&lru_list);
-
-	while(lru_clock)
+	if(front_hand == NULL)
 	{
+		front_hand = lru_clock;
+		for(step = 0; step < size / 4; step++)
+			front_hand = ring_next(front_hand);
+	}
 
-		struct list_elem *next = get_next_lru_clock();
+	for(step = 0; step < 2 * size; step++)
+	{
 		struct page *page = list_entry(lru_clock, struct page, lru);
 
-		lru_clock = next;
+		page_accessed(list_entry(front_hand, struct page, lru));
+		front_hand = ring_next(front_hand);
+		lru_clock = ring_next(lru_clock);
 
-		struct thread *t = page->thread;
-		if(pagedir_is_accessed(t->pagedir, page->vme->vaddr))
-			pagedir_set_accessed(t->pagedir, page->vme->vaddr, false);
+		/* skip frames not mapped yet, being written out, pinned
+		   for syscall I/O or used since the front hand passed */
+		if(list_empty(&page->vmes) || page->busy || page_pinned(page) || page_accessed(page))
+			continue;
 
-		else
+		if(!page_needs_write(page))
+			return evict_page(page);
+
+		if(dirty == NULL
+		   && !(background && swap_block == NULL
+		        && list_entry(list_front(&page->vmes), struct vm_entry, page_elem)->type != VM_FILE))
+			dirty = page;
+	}
+
+	return dirty != NULL ? evict_page(dirty) : 0;
+}
+
+/* reclaim in the faulting thread when no frame is free */
+void* try_to_free_pages(enum palloc_flags flags)
+{
+	direct_reclaim_cnt += reclaim_pages(false);
+	return palloc_get_page(flags);
+}
+
+/* write back up to PRECLEAN_MAX dirty file pages ahead of the back
+   hand, so evicting them later needs no I/O.  The pages stay mapped
+   but busy while lru_list_lock is released for the writes.
+   lru_list_lock must be held */
+static void preclean_pages(void)
+{
+	struct page *pages[PRECLEAN_MAX];
+	struct list_elem *e = lru_clock;
+	size_t size = list_size(&lru_list), i, cnt = 0;
+
+	for(i = 0; e != NULL && i < size && cnt < PRECLEAN_MAX; i++, e = ring_next(e))
+	{
+		struct page *page = list_entry(e, struct page, lru);
+		struct vm_entry *vme;
+
+		if(list_size(&page->vmes) != 1 || page->busy || page_pinned(page))
+			continue;
+		vme = list_entry(list_front(&page->vmes), struct vm_entry, page_elem);
+		if(vme->type != VM_FILE || !pagedir_is_dirty(vme->thread->pagedir, vme->vaddr))
+			continue;
+
+		/* a write during file_write_at() sets the bit again */
+		pagedir_set_dirty(vme->thread->pagedir, vme->vaddr, false);
+		page->busy = true;
+		pages[cnt++] = page;
+	}
+	if(cnt == 0)
+		return;
+
+	lock_release(&lru_list_lock);
+	for(i = 0; i < cnt; i++)
+	{
+		struct vm_entry *vme = list_entry(list_front(&pages[i]->vmes), struct vm_entry, page_elem);
+		file_write_at(vme->file, pages[i]->kaddr, vme->read_bytes, vme->offset);
+	}
+	lock_acquire(&lru_list_lock);
+
+	for(i = 0; i < cnt; i++)
+		pages[i]->busy = false;
+	cond_broadcast(&page_io_done, &lru_list_lock);
+	preclean_cnt += cnt;
+}
+
+/* wake the page-out daemon if free frames ran low; lru_list_lock
+   must be held */
+static void wake_pageout(void)
+{
+	if(!pageout_wanted && frame_cnt - frames_in_use < low_water)
+	{
+		pageout_wanted = true;
+		pageout_wakeup_cnt++;
+		sema_up(&pageout_sema);
+	}
+}
+
+/* kernel thread keeping high_water frames free */
+static void pageout_daemon(void *aux UNUSED)
+{
+	for(;;)
+	{
+		sema_down(&pageout_sema);
+
+		lock_acquire(&lru_list_lock);
+		while(frame_cnt - frames_in_use < high_water)
 		{
-			if(pagedir_is_dirty(t->pagedir, page->vme->vaddr) || page->vme->type == VM_ANON)
-			{
-				if(page->vme->type == VM_FILE)
-				{
-					lock_acquire(&filesys_lock);
-					file_write_at(page->vme->file, page->kaddr, page->vme->read_bytes, page->vme->offset);
-					lock_release(&filesys_lock);
-				}					
-				else if(page->vme->type != VM_ERROR)
-				{
-					page->vme->type = VM_ANON;
-					page->vme->swap_slot = swap_out(page->kaddr);
-				}
-			}
-
-			page->vme->is_loaded = false;
-	    del_page_from_lru_list(page);
-
-	    pagedir_clear_page(t->pagedir, page->vme->vaddr);
-	    palloc_free_page(page->kaddr);
-	    free(page);
-
-	    return palloc_get_page(flags);
+			size_t cnt = reclaim_pages(true);
+
+			if(cnt == 0)
+				break;
+			background_reclaim_cnt += cnt;
+
+			/* let faulting threads in between victims */
+			lock_release(&lru_list_lock);
+			lock_acquire(&lru_list_lock);
 		}
+		preclean_pages();
+		pageout_wanted = false;
+		lock_release(&lru_list_lock);
 	}
-	return NULL;
 }
 
 void lru_list_init(void)
 {
+	void *kaddr;
+
 	list_init(&lru_list);
 	lock_init(&lru_list_lock);
+	cond_init(&page_io_done);
 	lru_clock = NULL;
+	hash_init(&shared_pages, shared_hash_func, shared_less_func, NULL);
+
+	frame_base = palloc_user_pool(&frame_cnt);
+	frame_table = calloc(frame_cnt, sizeof *frame_table);
+	if(frame_table == NULL)
+		PANIC("frame: out of memory");
+
+	kaddr = palloc_get_page(PAL_USER | PAL_ZERO);
+	if(kaddr == NULL)
+		PANIC("frame: out of memory");
+	zero_page = frame_lookup(kaddr);
+	zero_page->kaddr = kaddr;
+	list_init(&zero_page->vmes);
+
+	low_water = frame_cnt / 32 + 1;
+	high_water = 2 * low_water;
+	sema_init(&pageout_sema, 0);
+	if(thread_create("pageout", PRI_DEFAULT, pageout_daemon, NULL) == TID_ERROR)
+		PANIC("frame: cannot start page-out daemon");
 }
 
 void add_page_to_lru_list(struct page *page)
@@ -92,8 +535,12 @@ void add_page_to_lru_list(struct page *page)
 	lock_release(&lru_list_lock);
 }
 
+/* lru_list_lock must be held */
 void del_page_from_lru_list(struct page *page)
 {
+	/* keep the clock hands off a removed page */
+	lru_clock = hand_past(lru_clock, page);
+	front_hand = hand_past(front_hand, page);
 	list_remove(&page -> lru);
 }
 
@@ -101,48 +548,445 @@ struct page* alloc_page(enum palloc_flags flags)
 {
 	void *kaddr = palloc_get_page(flags);
 
+	if(kaddr == NULL)
+	{
+		lock_acquire(&lru_list_lock);
+		alloc_stall_cnt++;
+		wake_pageout();
+		lock_release(&lru_list_lock);
+	}
 	while(kaddr == NULL)
 	{
 		lock_acquire(&lru_list_lock);
 		kaddr = try_to_free_pages(flags);
 		lock_release(&lru_list_lock);
 	}
-	struct page *page = (struct page*)malloc(sizeof(struct page));
+	return new_page(kaddr);
+}
 
-	if(page == NULL)
+/* like alloc_page(), but returns NULL instead of evicting when no
+   frame is free */
+struct page* try_alloc_page(enum palloc_flags flags)
+{
+	void *kaddr = palloc_get_page(flags);
+
+	if(kaddr == NULL)
 		return NULL;
-	
+	return new_page(kaddr);
+}
+
+/* take the descriptor of user frame KADDR and put it on the LRU list */
+static struct page* new_page(void *kaddr)
+{
+	struct page *page;
+
+	lock_acquire(&lru_list_lock);
+	page = frame_lookup(kaddr);
+	ASSERT(page->kaddr == NULL);
+
 	page->kaddr = kaddr;
-	page->thread = thread_current();
-	page->vme = NULL;
+	list_init(&page->vmes);
+	page->busy = false;
+	page->shared = false;
+	page->inumber = 0;
+	page->offset = 0;
+	page->read_bytes = 0;
 
-	add_page_to_lru_list(page);
+	if(++frames_in_use > frames_peak)
+		frames_peak = frames_in_use;
+	list_push_back(&lru_list, &page->lru);
+	wake_pageout();
+	lock_release(&lru_list_lock);
 
 	return page;
 }
 
+/* release user frame KADDR and all its mappings, if it is in use */
 void free_page(void *kaddr)
 {
-	struct list_elem *e;
-	for(e = list_begin(&lru_list); e != list_end(&lru_list);)
+	struct page *page;
+
+	lock_acquire(&lru_list_lock);
+	page = frame_lookup(kaddr);
+	if(page->kaddr != NULL)
+		page_release(page);
+	lock_release(&lru_list_lock);
+}
+
+/* free a frame that was never mapped */
+void __free_page(struct page *page)
+{
+	lock_acquire(&lru_list_lock);
+	page_release(page);
+	lock_release(&lru_list_lock);
+}
+
+/* map PAGE at VME's address in VME's process */
+bool map_page(struct page *page, struct vm_entry *vme)
+{
+	bool success;
+
+	lock_acquire(&lru_list_lock);
+	success = pagedir_set_page(vme->thread->pagedir, vme->vaddr, page->kaddr, vme->writable);
+	if(success)
 	{
-		struct list_elem *next_elem = list_next(e);
-		struct page *page = list_entry(e, struct page, lru);
-		if(page->kaddr == kaddr)
+		list_push_back(&page->vmes, &vme->page_elem);
+		vme->page = page;
+		vme->is_loaded = true;
+	}
+	lock_release(&lru_list_lock);
+
+	return success;
+}
+
+/* drop VME's mapping; the frame is freed with its last mapping.
+   A page that was swapped out gives up its swap slot instead */
+void unmap_page(struct vm_entry *vme)
+{
+	struct page *page;
+
+	lock_acquire(&lru_list_lock);
+	page_io_wait(vme);
+	page = vme->page;
+	if(page == NULL)
+	{
+		if(vme->type == VM_ANON)
 		{
-			__free_page(page);
-			break;
+			swap_free(vme->swap_slot);
+			vme->swap_slot = BITMAP_ERROR;
 		}
-		e = next_elem;
+		lock_release(&lru_list_lock);
+		return;
 	}
+
+	list_remove(&vme->page_elem);
+	pagedir_clear_page(vme->thread->pagedir, vme->vaddr);
+	vme->is_loaded = false;
+	vme->page = NULL;
+	if(page == zero_page)
+		zero_in_use--;
+	else if(list_empty(&page->vmes))
+		page_release(page);
+	lock_release(&lru_list_lock);
 }
 
-void __free_page(struct page *page)
+/* look up VME's text in the shared text cache; must hold lru_list_lock */
+static struct page *find_shared_page(struct vm_entry *vme)
 {
+	struct page key;
+	struct hash_elem *e;
+
+	key.inumber = inode_get_inumber(file_get_inode(vme->file));
+	key.offset = vme->offset;
+	key.read_bytes = vme->read_bytes;
+	e = hash_find(&shared_pages, &key.share_elem);
+	return e != NULL ? hash_entry(e, struct page, share_elem) : NULL;
+}
+
+/* map VME to a frame another process already loaded with the same
+   read-only text, if there is one */
+bool map_shared_page(struct vm_entry *vme)
+{
+	struct page *page;
+	bool success = false;
+
 	lock_acquire(&lru_list_lock);
-	del_page_from_lru_list(page);
+	page = find_shared_page(vme);
+	if(page != NULL
+	   && pagedir_set_page(vme->thread->pagedir, vme->vaddr, page->kaddr, false))
+	{
+		list_push_back(&page->vmes, &vme->page_elem);
+		vme->page = page;
+		vme->is_loaded = true;
+		shared_hit_cnt++;
+		success = true;
+	}
+	lock_release(&lru_list_lock);
+
+	return success;
+}
+
+/* enter PAGE, just loaded for read-only text VME, in the shared
+   text cache and map it.  If another process loaded the same text
+   meanwhile, map that frame instead and free PAGE */
+bool map_new_shared_page(struct page *page, struct vm_entry *vme)
+{
+	struct page *other;
+	bool success;
+
+	lock_acquire(&lru_list_lock);
+	other = find_shared_page(vme);
+	if(other != NULL)
+	{
+		page_release(page);
+		page = other;
+	}
+	else
+	{
+		page->shared = true;
+		page->inumber = inode_get_inumber(file_get_inode(vme->file));
+		page->offset = vme->offset;
+		page->read_bytes = vme->read_bytes;
+		hash_insert(&shared_pages, &page->share_elem);
+	}
+
+	success = pagedir_set_page(vme->thread->pagedir, vme->vaddr, page->kaddr, false);
+	if(success)
+	{
+		list_push_back(&page->vmes, &vme->page_elem);
+		vme->page = page;
+		vme->is_loaded = true;
+	}
+	else if(list_empty(&page->vmes))
+		page_release(page);
+	lock_release(&lru_list_lock);
+
+	return success;
+}
+
+/* share SRC's frame or swap slot with DST, a copy of SRC made for
+   fork.  Writable pages are mapped read-only in both processes
+   until one of them writes, see unshare_page() */
+bool fork_page(struct vm_entry *src, struct vm_entry *dst)
+{
+	struct page *page;
+	bool success = true;
+
+	lock_acquire(&lru_list_lock);
+	page_io_wait(src);
+	page = src->page;
+	dst->type = src->type;
+	dst->swap_slot = BITMAP_ERROR;
+	if(page != NULL)
+	{
+		uint32_t *pd = src->thread->pagedir;
+		bool dirty = pagedir_is_dirty(pd, src->vaddr);
+
+		if(src->writable)
+		{
+			pagedir_clear_page(pd, src->vaddr);
+			pagedir_set_page(pd, src->vaddr, page->kaddr, false);
+			pagedir_set_dirty(pd, src->vaddr, dirty);
+		}
+
+		success = pagedir_set_page(dst->thread->pagedir, dst->vaddr, page->kaddr, false);
+		if(success)
+		{
+			pagedir_set_dirty(dst->thread->pagedir, dst->vaddr, dirty);
+			list_push_back(&page->vmes, &dst->page_elem);
+			dst->page = page;
+			dst->is_loaded = true;
+			if(page == zero_page && ++zero_in_use > zero_peak)
+				zero_peak = zero_in_use;
+		}
+	}
+	else if(src->type == VM_ANON && src->swap_slot != BITMAP_ERROR)
+	{
+		swap_share(src->swap_slot);
+		dst->swap_slot = src->swap_slot;
+	}
+	lock_release(&lru_list_lock);
+
+	return success;
+}
+
+/* map VME to the shared zero frame, read-only, if nobody has
+   written its page yet: a BSS page or a stack page never swapped
+   out.  The first write copies it, see unshare_page() */
+bool map_zero_page(struct vm_entry *vme)
+{
+	bool success;
+
+	if(vme->is_loaded
+	   || !((vme->type == VM_BIN && vme->read_bytes == 0)
+	        || (vme->type == VM_ANON && vme->swap_slot == BITMAP_ERROR)))
+		return false;
+
+	lock_acquire(&lru_list_lock);
+	success = pagedir_set_page(vme->thread->pagedir, vme->vaddr, zero_page->kaddr, false);
+	if(success)
+	{
+		list_push_back(&zero_page->vmes, &vme->page_elem);
+		vme->page = zero_page;
+		vme->is_loaded = true;
+		zero_map_cnt++;
+		if(++zero_in_use > zero_peak)
+			zero_peak = zero_in_use;
+	}
+	lock_release(&lru_list_lock);
+
+	return success;
+}
+
+/* handle a write to writable VME while its frame is shared after
+   fork or is the zero frame: copy the frame unless VME is its last
+   mapping, then map it writable */
+bool unshare_page(struct vm_entry *vme)
+{
+	struct page *page, *copy = NULL;
+	uint32_t *pd = vme->thread->pagedir;
+	bool success = true;
+
+	lock_acquire(&lru_list_lock);
+	page_io_wait(vme);
+	page = vme->page;
+	if(page != NULL && (list_size(&page->vmes) > 1 || page == zero_page))
+	{
+		lock_release(&lru_list_lock);
+		copy = alloc_page(PAL_USER);
+		if(copy == NULL)
+			return false;
+		lock_acquire(&lru_list_lock);
+		page_io_wait(vme);
+		page = vme->page;
+	}
+
+	/* evicted meanwhile: the retried write faults it back in */
+	if(page == NULL)
+		;
+	else if(list_size(&page->vmes) == 1 && page != zero_page)
+	{
+		bool dirty = pagedir_is_dirty(pd, vme->vaddr);
+
+		pagedir_clear_page(pd, vme->vaddr);
+		success = pagedir_set_page(pd, vme->vaddr, page->kaddr, true);
+		pagedir_set_dirty(pd, vme->vaddr, dirty);
+	}
+	else
+	{
+		memcpy(copy->kaddr, page->kaddr, PGSIZE);
+		list_remove(&vme->page_elem);
+		pagedir_clear_page(pd, vme->vaddr);
+		success = pagedir_set_page(pd, vme->vaddr, copy->kaddr, true);
+		if(success)
+		{
+			list_push_back(&copy->vmes, &vme->page_elem);
+			vme->page = copy;
+			copy = NULL;
+		}
+		else
+		{
+			vme->page = NULL;
+			vme->is_loaded = false;
+		}
+		if(page == zero_page)
+		{
+			zero_in_use--;
+			zero_cow_cnt++;
+		}
+		else
+			cow_cnt++;
+	}
+
+	if(copy != NULL)
+		page_release(copy);
+	lock_release(&lru_list_lock);
+
+	return success;
+}
+
+/* keep VME's frame from being evicted while the kernel accesses
+   it.  Returns true if the page is already loaded */
+bool pin_page(struct vm_entry *vme)
+{
+	bool loaded;
+
+	lock_acquire(&lru_list_lock);
+	page_io_wait(vme);
+	vme->pinned = true;
+	loaded = vme->is_loaded;
+	lock_release(&lru_list_lock);
+
+	return loaded;
+}
+
+/* let VME's frame be evicted again */
+void unpin_page(struct vm_entry *vme)
+{
+	lock_acquire(&lru_list_lock);
+	vme->pinned = false;
+	lock_release(&lru_list_lock);
+}
+
+/* write mmap entry VME's page back to its file if it was written
+   since it was loaded or last synced */
+void sync_page(struct vm_entry *vme)
+{
+	uint32_t *pd = vme->thread->pagedir;
+	struct page *page;
+
+	lock_acquire(&lru_list_lock);
+	page_io_wait(vme);
+	page = vme->page;
+	if(page != NULL && pagedir_is_dirty(pd, vme->vaddr))
+	{
+		/* a write during file_write_at() sets the bit again */
+		pagedir_set_dirty(pd, vme->vaddr, false);
+		page->busy = true;
+		lock_release(&lru_list_lock);
+		file_write_at(vme->file, page->kaddr, vme->read_bytes, vme->offset);
+		lock_acquire(&lru_list_lock);
+		page->busy = false;
+		cond_broadcast(&page_io_done, &lru_list_lock);
+		sync_cnt++;
+	}
 	lock_release(&lru_list_lock);
-	palloc_free_page(page->kaddr);
-	free(page);
 }
 
+/* wait until VME's frame is no longer being written out, so that a
+   fault on a page caught mid-eviction sees it evicted */
+void wait_on_page(struct vm_entry *vme)
+{
+	lock_acquire(&lru_list_lock);
+	page_io_wait(vme);
+	lock_release(&lru_list_lock);
+}
+
+/* make VME's frame, if it has one, the next the back hand of the
+   clock looks at, with its accessed bits clear, so it is evicted
+   next unless it is used again first */
+void deactivate_page(struct vm_entry *vme)
+{
+	struct page *page;
+
+	lock_acquire(&lru_list_lock);
+	page = vme->page;
+	if(page != NULL && &page->lru != lru_clock)
+	{
+		page_accessed(page);
+		del_page_from_lru_list(page);
+		if(lru_clock != NULL)
+			list_insert(lru_clock, &page->lru);
+		else
+			list_push_back(&lru_list, &page->lru);
+		lru_clock = &page->lru;
+		deactivate_cnt++;
+	}
+	lock_release(&lru_list_lock);
+}
+
+/* count a page read in from a file, AROUND if by fault-around
+   rather than for the faulting address */
+void count_page_in(bool around)
+{
+	lock_acquire(&lru_list_lock);
+	page_in_cnt++;
+	if(around)
+		fault_around_cnt++;
+	lock_release(&lru_list_lock);
+}
+
+/* print frame statistics */
+void frame_print_stats(void)
+{
+	printf("Frames: %d peak in use, %lld page-ins (%lld by fault-around), %lld shared text hits, "
+	       "%lld evictions, %lld copy-on-write faults\n",
+	       frames_peak, page_in_cnt, fault_around_cnt, shared_hit_cnt, evict_cnt, cow_cnt);
+	printf("Reclaim: %lld clean and %lld dirty evictions, %lld direct and %lld background, "
+	       "%lld pages pre-cleaned, %lld daemon wakeups, %lld allocations stalled\n",
+	       clean_evict_cnt, dirty_evict_cnt, direct_reclaim_cnt, background_reclaim_cnt,
+	       preclean_cnt, pageout_wakeup_cnt, alloc_stall_cnt);
+	printf("Mmap: %lld pages synced, %lld pages deactivated\n", sync_cnt, deactivate_cnt);
+	printf("Zero page: %lld read faults mapped it, %lld later written, %d frames saved at peak\n",
+	       zero_map_cnt, zero_cow_cnt, zero_peak);
+}
@@ -12,15 +12,32 @@ struct lock lru_list_lock;
 struct list lru_list;
 struct list_elem *lru_clock;
 
-struct list_elem *get_next_lru_clock();
-void* try_to_free_page(enum palloc_flags flags);
+struct list_elem *get_next_lru_clock(void);
+void* try_to_free_pages(enum palloc_flags flags);
 
 void lru_list_init(void);
 void add_page_to_lru_list(struct page *page);
 void del_page_from_lru_list(struct page *page);
 
 struct page *alloc_page(enum palloc_flags flags);
+struct page *try_alloc_page(enum palloc_flags flags);
 void free_page(void *kaddr);
 void __free_page(struct page *page);
 
+bool map_page(struct page *page, struct vm_entry *vme);
+void unmap_page(struct vm_entry *vme);
+bool map_shared_page(struct vm_entry *vme);
+bool map_new_shared_page(struct page *page, struct vm_entry *vme);
+bool fork_page(struct vm_entry *src, struct vm_entry *dst);
+bool map_zero_page(struct vm_entry *vme);
+bool unshare_page(struct vm_entry *vme);
+bool pin_page(struct vm_entry *vme);
+void unpin_page(struct vm_entry *vme);
+void sync_page(struct vm_entry *vme);
+void wait_on_page(struct vm_entry *vme);
+void deactivate_page(struct vm_entry *vme);
+
+void count_page_in(bool around);
+void frame_print_stats(void);
+
 #endif 
@@ -9,6 +9,8 @@
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
 #include "userprog/syscall.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
 
 static unsigned vm_hash_func(const struct hash_elem *e, void *aux);
 static bool vm_less_func(const struct hash_elem *a, const struct hash_elem *b); 
@@ -64,29 +66,57 @@ void vm_destroy_func(struct hash_elem *e, void *aux UNUSED)
 {
 	struct vm_entry *vme = hash_entry(e, struct vm_entry, elem);
 	
-	if(vme->is_loaded)
+	/* a shared frame stays until its last mapping goes away */
+	unmap_page(vme);
+	free(vme);
+}
+
+/* copy the address space SRC into DST, the current process's, for
+   fork.  Pages stay shared copy-on-write; executable pages are read
+   through RUN_FILE, the child's own handle on the executable.
+   Memory-mapped files are not inherited */
+bool vm_copy(struct hash *dst, struct hash *src, struct file *run_file)
+{
+	struct hash_iterator i;
+
+	hash_first(&i, src);
+	while(hash_next(&i))
 	{
-		palloc_free_page(pagedir_get_page(thread_current()->pagedir, vme->vaddr));
-		pagedir_clear_page(thread_current()->pagedir, vme->vaddr);
+		struct vm_entry *src_vme = hash_entry(hash_cur(&i), struct vm_entry, elem);
+		struct vm_entry *vme;
+
+		if(src_vme->type == VM_FILE)
+			continue;
+
+		vme = (struct vm_entry*)malloc(sizeof(struct vm_entry));
+		if(vme == NULL)
+			return false;
+
+		*vme = *src_vme;
+		vme->file = run_file;
+		vme->is_loaded = false;
+		vme->pinned = false;
+		vme->thread = thread_current();
+		vme->page = NULL;
+
+		if(!fork_page(src_vme, vme))
+		{
+			free(vme);
+			return false;
+		}
+		insert_vme(dst, vme);
 	}
-	free(vme);
+	return true;
 }
 
 bool load_file(void *kaddr, struct vm_entry *vme)						
 {
 	if(vme->read_bytes > 0)
 	{
-		lock_acquire(&filesys_lock);
 		if((unsigned int)(vme->read_bytes) == file_read_at(vme->file, kaddr, vme->read_bytes, vme->offset))
-		{
-			lock_release(&filesys_lock);
 			memset(kaddr + vme->read_bytes, 0, vme->zero_bytes);					
-		}
 		else
-		{
-			lock_release(&filesys_lock);
 			return false;		
-		}
 	}
 	else
 	{
@@ -96,19 +126,124 @@ bool load_file(void *kaddr, struct vm_entry *vme)
 	return true;
 }
 
+/* read VM_BIN or VM_FILE entry VME's page into a frame taken
+   without eviction and map it.  Returns false if no frame was free
+   or the read failed */
+bool prefetch_page(struct vm_entry *vme)
+{
+	bool shared = vme->type == VM_BIN && !vme->writable;
+	struct page *page;
 
+	if(shared && map_shared_page(vme))
+		return true;
 
+	page = try_alloc_page(PAL_USER);
+	if(page == NULL)
+		return false;
+	if(!load_file(page->kaddr, vme))
+	{
+		__free_page(page);
+		return false;
+	}
+	count_page_in(true);
 
+	if(shared)
+		return map_new_shared_page(page, vme);
+	if(!map_page(page, vme))
+	{
+		__free_page(page);
+		return false;
+	}
+	return true;
+}
 
+/* after a fault loaded VM_BIN or VM_FILE entry VME, also map the
+   following pages of the same file that are not loaded yet, up to
+   the current thread's fault_window of them.  The window doubles
+   while faults land just past the previous window and halves when
+   they do not, so a sequential scan takes few faults and random
+   access reads nothing extra.  Stops early when no frame is free
+   without eviction.
+
+   madvise() overrides the window: MADV_RANDOM reads nothing ahead
+   and MADV_SEQUENTIAL always reads FAULT_AROUND_MAX pages and
+   deactivates as many pages behind the fault, so a streaming job
+   replaces its own pages rather than other processes' */
+void load_around(struct vm_entry *vme)
+{
+	struct thread *t = thread_current();
+	size_t window, i, cnt = 0;
 
+	if(vme->advice == MADV_RANDOM)
+		return;
 
+	if(vme->vaddr == t->fault_next)
+		t->fault_window = t->fault_window == 0 ? 1
+		                : t->fault_window * 2 < FAULT_AROUND_MAX ? t->fault_window * 2 : FAULT_AROUND_MAX;
+	else
+		t->fault_window /= 2;
+	window = vme->advice == MADV_SEQUENTIAL ? FAULT_AROUND_MAX : t->fault_window;
 
+	for(i = 1; i <= window; i++)
+	{
+		struct vm_entry *next = find_vme(vme->vaddr + i * PGSIZE);
 
+		if(next == NULL || next->is_loaded || next->type != vme->type
+		   || next->file != vme->file || next->offset != vme->offset + i * PGSIZE
+		   || !prefetch_page(next))
+			break;
+		cnt++;
+	}
+	t->fault_next = vme->vaddr + (cnt + 1) * PGSIZE;
 
+	if(vme->advice == MADV_SEQUENTIAL)
+		for(i = 1; i <= FAULT_AROUND_MAX && i * PGSIZE <= vme->offset; i++)
+		{
+			struct vm_entry *prev = find_vme(vme->vaddr - i * PGSIZE);
 
+			if(prev == NULL || prev->file != vme->file || prev->offset + i * PGSIZE != vme->offset)
+				break;
+			deactivate_page(prev);
+		}
+}
 
+/* swap VME's page in to KADDR, together with the pages after it in
+   the address space that went to swap in the same cluster, with a
+   single block request.  Read-ahead stops at the first page that is
+   not in the next slot or when no frame is free without eviction */
+void swap_in_around(struct vm_entry *vme, void *kaddr)
+{
+	struct vm_entry *vmes[SWAP_CLUSTER];
+	struct page *pages[SWAP_CLUSTER];
+	void *kaddrs[SWAP_CLUSTER];
+	size_t cnt, i;
 
+	kaddrs[0] = kaddr;
+	for(cnt = 1; cnt < SWAP_CLUSTER; cnt++)
+	{
+		struct vm_entry *next = find_vme(vme->vaddr + cnt * PGSIZE);
+
+		if(next == NULL || next->type != VM_ANON || next->is_loaded
+		   || next->swap_slot != vme->swap_slot + cnt)
+			break;
+		pages[cnt] = try_alloc_page(PAL_USER);
+		if(pages[cnt] == NULL)
+			break;
+		vmes[cnt] = next;
+		kaddrs[cnt] = pages[cnt]->kaddr;
+	}
 
+	swap_in_cluster(vme->swap_slot, kaddrs, cnt);
+	vme->swap_slot = BITMAP_ERROR;
 
-
-
+	for(i = 1; i < cnt; i++)
+	{
+		vmes[i]->swap_slot = BITMAP_ERROR;
+		if(!map_page(pages[i], vmes[i]))
+		{
+			/* no page table: put it back rather than lose it */
+			vmes[i]->swap_slot = swap_out(pages[i]->kaddr);
+			__free_page(pages[i]);
+		}
+	}
+}
@@ -5,19 +5,26 @@
 #include <debug.h>
 #include <list.h>
 #include <hash.h>
+#include <syscall-nr.h>
 #include "threads/palloc.h"
+#include "devices/block.h"
 
 #define VM_BIN 0
 #define VM_FILE 1
 #define VM_ANON 2
 #define VM_ERROR 3
 
+/* most pages load_around() maps after a faulting one */
+#define FAULT_AROUND_MAX 16
+
 struct vm_entry
 {
 	uint8_t type;	
 	void *vaddr;	
 	bool writable;	
 	bool is_loaded; 
+	bool pinned;			/* pinned for kernel I/O, never evicted */
+	uint8_t advice;			/* MADV_* from madvise() */
 
 	struct file* file; 
 	struct list_elem mmap_elem;
@@ -28,6 +35,10 @@ struct vm_entry
 	size_t swap_slot; 
 
 	struct hash_elem elem; 
+
+	struct thread *thread;		/* process owning this mapping */
+	struct page *page;		/* frame holding the page, if loaded */
+	struct list_elem page_elem;	/* element in page->vmes */
 };
 
 struct mmap_file 
@@ -41,23 +52,35 @@ struct mmap_file
 struct page 
 {
 	void *kaddr;
-	struct vm_entry *vme;
-	struct thread* thread;
+	struct list vmes;		/* vm_entries mapping this frame */
 	struct list_elem lru; 
+	bool busy;			/* being written out with lru_list_lock
+					   released; the clock skips it and
+					   anyone else using it waits */
+
+	bool shared;			/* shared read-only text: */
+	block_sector_t inumber;		/* inode sector of the file, */
+	size_t offset;			/* offset and length it was */
+	size_t read_bytes;		/* read from */
+	struct hash_elem share_elem;
 };
 
 void vm_init(struct hash *vm);
 void vm_destroy(struct hash *vm);
+bool vm_copy(struct hash *dst, struct hash *src, struct file *run_file);
 
 struct vm_entry *find_vme(void* vaddr); 
 bool insert_vme(struct hash *vm, struct vm_entry *vme);
 bool delete_vme(struct hash *vm, struct vm_entry *vme); 
 
 bool load_file(void *kaddr, struct vm_entry *vme);
+void swap_in_around(struct vm_entry *vme, void *kaddr);
+bool prefetch_page(struct vm_entry *vme);
+void load_around(struct vm_entry *vme);
 
 bool handle_mm_fault(struct vm_entry *vme);
 
-void check_valid_buffer(void* buffer, unsigned int size, void* esp, bool to_write);
-void check_valid_string(const void *str, void* esp);
+void check_valid_buffer(void* buffer, unsigned int size);
+void unpin_buffer(void* buffer, unsigned int size);
 
 #endif
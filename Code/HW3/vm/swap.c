@@ -1,3 +1,5 @@
+#include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
@@ -7,42 +9,189 @@
 #include "vm/frame.h"
 #include "vm/page.h"
 #include "vm/swap.h"
+#include "vm/zswap.h"
 
+/* number of vm_entries holding each swap slot; fork shares them,
+   so it must count past 255 */
+static uint16_t *swap_refs;
+
+/* bounce buffer for clusters, which are contiguous on disk but
+   not in memory.  Guarded by swap_lock */
+static uint8_t *swap_buf;
+
+/* devices that swap slots are striped across a page at a time:
+   slot S is slot S / swap_dev_cnt of swap_devs[S % swap_dev_cnt].
+   swap_devs[0] is swap_block */
+static struct block *swap_devs[SWAP_DEV_MAX];
+static size_t swap_dev_cnt;
+
+/* statistics */
+static long long swap_out_pages, swap_out_requests;
+static long long swap_in_pages, swap_in_requests;
+static long long swap_dev_pages[SWAP_DEV_MAX];
+
+/* use the swap role device and every other device of swap type,
+   which are often swap partitions on other disks.  Each device
+   contributes as many slots as the smallest one has */
 void swap_init(void)
 {
+	struct block *block;
+	size_t dev_slots, i;
+
 	swap_block = block_get_role(BLOCK_SWAP);				
 	
 	if(swap_block == NULL) 											
 		return;
 
-	swap_map = bitmap_create(block_size(swap_block) / SECTORS_PER_PAGE); 
+	swap_devs[swap_dev_cnt++] = swap_block;
+	for(block = block_first(); block != NULL && swap_dev_cnt < SWAP_DEV_MAX; block = block_next(block))
+		if(block != swap_block && block_type(block) == BLOCK_SWAP)
+		{
+			printf("swap: striping across %s\n", block_name(block));
+			swap_devs[swap_dev_cnt++] = block;
+		}
+
+	dev_slots = block_size(swap_block) / SECTORS_PER_PAGE;
+	for(i = 1; i < swap_dev_cnt; i++)
+		if(block_size(swap_devs[i]) / SECTORS_PER_PAGE < dev_slots)
+			dev_slots = block_size(swap_devs[i]) / SECTORS_PER_PAGE;
+
+	swap_map = bitmap_create(dev_slots * swap_dev_cnt); 
 
 	if(swap_map == NULL) 
 		return;
 
 	bitmap_set_all(swap_map, 0);		
+	swap_refs = calloc(bitmap_size(swap_map), sizeof *swap_refs);
+	swap_buf = palloc_get_multiple(0, SWAP_CLUSTER);
+	if(swap_refs == NULL || swap_buf == NULL)
+		PANIC("swap: out of memory");
+	zswap_init();
 	lock_init(&swap_lock);					
 }	
 
+/* move CNT pages between KADDRS and the consecutive slots starting
+   at SLOT.  The slots of each device are consecutive on that
+   device, so each device gets one request, and the requests are
+   all in flight at once so that devices on different channels
+   work in parallel.  swap_lock must be held */
+static void transfer_run(size_t slot, void **kaddrs, size_t cnt, bool write)
+{
+	struct block_request reqs[SWAP_DEV_MAX];
+	size_t first[SWAP_DEV_MAX], pages[SWAP_DEV_MAX];
+	uint8_t *buf = swap_buf;
+	size_t d, i;
+
+	if(cnt == 0)
+		return;
+
+	for(d = 0; d < swap_dev_cnt; d++)
+	{
+		/* device D holds slots first[d], first[d] + swap_dev_cnt, ... */
+		first[d] = slot + (d + swap_dev_cnt - slot % swap_dev_cnt) % swap_dev_cnt;
+		pages[d] = first[d] < slot + cnt ? (slot + cnt - first[d] + swap_dev_cnt - 1) / swap_dev_cnt : 0;
+		if(pages[d] == 0)
+			continue;
+
+		if(pages[d] == 1)
+			block_request_init(&reqs[d], first[d] / swap_dev_cnt * SECTORS_PER_PAGE, SECTORS_PER_PAGE,
+			                   kaddrs[first[d] - slot], write);
+		else
+		{
+			if(write)
+				for(i = 0; i < pages[d]; i++)
+					memcpy(buf + i * PGSIZE, kaddrs[first[d] - slot + i * swap_dev_cnt], PGSIZE);
+			block_request_init(&reqs[d], first[d] / swap_dev_cnt * SECTORS_PER_PAGE,
+			                   pages[d] * SECTORS_PER_PAGE, buf, write);
+			buf += pages[d] * PGSIZE;
+		}
+		block_submit(swap_devs[d], &reqs[d]);
+		swap_dev_pages[d] += pages[d];
+		if(write)
+			swap_out_requests++;
+		else
+			swap_in_requests++;
+	}
+
+	for(d = 0; d < swap_dev_cnt; d++)
+	{
+		if(pages[d] == 0)
+			continue;
+		block_wait(&reqs[d]);
+		if(!write && pages[d] > 1)
+			for(i = 0; i < pages[d]; i++)
+				memcpy(kaddrs[first[d] - slot + i * swap_dev_cnt], (uint8_t *) reqs[d].buffer + i * PGSIZE, PGSIZE);
+	}
+}
+
+/* read CNT pages from consecutive slots starting at SLOT;
+   swap_lock must be held */
+static void read_run(size_t slot, void **kaddrs, size_t cnt)
+{
+	transfer_run(slot, kaddrs, cnt, false);
+}
+
+/* write CNT pages to consecutive slots starting at SLOT;
+   swap_lock must be held */
+static void write_run(size_t slot, void **kaddrs, size_t cnt)
+{
+	transfer_run(slot, kaddrs, cnt, true);
+}
+
+/* write the page at KADDR to SLOT; swap_lock must be held */
+void swap_write_slot(size_t slot, void *kaddr)
+{
+	write_run(slot, &kaddr, 1);
+}
+
 void swap_in(size_t used_index, void *kaddr)
 {
+	swap_in_cluster(used_index, &kaddr, 1);
+}
+
+/* read CNT pages from the slots starting at used_index into KADDRS,
+   with as few block requests as the compressed cache allows */
+void swap_in_cluster(size_t used_index, void **kaddrs, size_t cnt)
+{
+	size_t i;
 
 	if(swap_block == NULL || swap_map == NULL)		
 		return;
 
+	ASSERT(cnt >= 1 && cnt <= SWAP_CLUSTER);
+
 	lock_acquire(&swap_lock);											
 
-	if(bitmap_test(swap_map, used_index) == 0)		
+	if(bitmap_all(swap_map, used_index, cnt) == false)		
 	{
 		NOT_REACHED();
 	}		
 	else																				
 	{
-		unsigned int i;
-		for(i = 0; i < SECTORS_PER_PAGE; i++)
-			block_read(swap_block, used_index * SECTORS_PER_PAGE + i, (uint8_t*) kaddr + i * BLOCK_SECTOR_SIZE);
+		size_t run = 0;
+
+		/* pages the compressed cache holds need no disk read; read
+		   each run of the others with one request */
+		for(i = 0; i < cnt; i++)
+		{
+			if(zswap_load(used_index + i, kaddrs[i]))
+			{
+				read_run(used_index + i - run, kaddrs + i - run, run);
+				run = 0;
+			}
+			else
+				run++;
+		}
+		read_run(used_index + cnt - run, kaddrs + cnt - run, run);
+
+		for(i = used_index; i < used_index + cnt; i++)
+			if(--swap_refs[i] == 0)
+			{
+				bitmap_reset(swap_map, i);					
+				zswap_invalidate(i);
+			}
 
-		bitmap_flip(swap_map, used_index);					
+		swap_in_pages += cnt;
 	}
 
 	lock_release(&swap_lock);											
@@ -50,26 +199,94 @@ void swap_in(size_t used_index, void *kaddr)
 
 size_t swap_out(void *kaddr)
 {
+	size_t free_index = swap_out_cluster(&kaddr, 1);
+
+	if(free_index == BITMAP_ERROR)					
+		NOT_REACHED();
+
+	return free_index;
+}
+
+/* write CNT pages from KADDRS to consecutive free slots, keeping
+   those that compress well in memory and writing the rest with as
+   few block requests as possible.  Returns the first slot, or BITMAP_ERROR if there
+   is no run of CNT free slots */
+size_t swap_out_cluster(void **kaddrs, size_t cnt)
+{
+	size_t free_index, i;
+
 	if(swap_block == NULL || swap_map == NULL)		
 		NOT_REACHED();
 
+	ASSERT(cnt >= 1 && cnt <= SWAP_CLUSTER);
+
 	lock_acquire(&swap_lock);											
 	
-	
-	size_t free_index = bitmap_scan_and_flip(swap_map, 0, 1, 0);	
+	free_index = bitmap_scan_and_flip(swap_map, 0, cnt, 0);	
 
-	if(free_index == BITMAP_ERROR)					
-	{
-		NOT_REACHED();
-	}
-	else																				
+	if(free_index != BITMAP_ERROR)					
 	{
-		unsigned int i;
-		for(i = 0; i < SECTORS_PER_PAGE; i++)
-			block_write(swap_block, free_index * SECTORS_PER_PAGE + i, (uint8_t *) kaddr+ i * BLOCK_SECTOR_SIZE);
+		size_t run = 0;
+
+		/* pages that compress stay in memory; write each run of the
+		   others with one request */
+		for(i = 0; i < cnt; i++)
+		{
+			if(zswap_store(free_index + i, kaddrs[i]))
+			{
+				write_run(free_index + i - run, kaddrs + i - run, run);
+				run = 0;
+			}
+			else
+				run++;
+		}
+		write_run(free_index + cnt - run, kaddrs + cnt - run, run);
+
+		for(i = free_index; i < free_index + cnt; i++)
+			swap_refs[i] = 1;
+
+		swap_out_pages += cnt;
 	}
 
 	lock_release(&swap_lock);									
 
 	return free_index;
 }
+
+/* let one more vm_entry read the page in slot used_index */
+void swap_share(size_t used_index)
+{
+	lock_acquire(&swap_lock);
+	ASSERT(bitmap_test(swap_map, used_index));
+	ASSERT(swap_refs[used_index] < UINT16_MAX);
+	swap_refs[used_index]++;
+	lock_release(&swap_lock);
+}
+
+/* drop a vm_entry's claim on slot used_index without reading it */
+void swap_free(size_t used_index)
+{
+	if(swap_block == NULL || swap_map == NULL || used_index == BITMAP_ERROR)
+		return;
+
+	lock_acquire(&swap_lock);
+	ASSERT(bitmap_test(swap_map, used_index));
+	if(--swap_refs[used_index] == 0)
+	{
+		bitmap_reset(swap_map, used_index);
+		zswap_invalidate(used_index);
+	}
+	lock_release(&swap_lock);
+}
+
+/* print swap statistics */
+void swap_print_stats(void)
+{
+	size_t d;
+
+	printf("Swap: %lld pages out in %lld requests, %lld pages in in %lld requests\n",
+	       swap_out_pages, swap_out_requests, swap_in_pages, swap_in_requests);
+	for(d = 0; d < swap_dev_cnt; d++)
+		printf("Swap: %s moved %lld pages\n", block_name(swap_devs[d]), swap_dev_pages[d]);
+	zswap_print_stats();
+}
@@ -9,6 +9,12 @@
 
 #define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
 
+/* most pages moved to or from swap in one block request */
+#define SWAP_CLUSTER 8
+
+/* most devices swap slots are striped across */
+#define SWAP_DEV_MAX 4
+
 struct lock swap_lock;
 struct block *swap_block;
 struct bitmap *swap_map;
@@ -16,5 +22,11 @@ struct bitmap *swap_map;
 void swap_init(void);
 size_t swap_out(void *kaddr);
 void swap_in(size_t used_index, void *kaddr);
+size_t swap_out_cluster(void **kaddrs, size_t cnt);
+void swap_in_cluster(size_t used_index, void **kaddrs, size_t cnt);
+void swap_share(size_t used_index);
+void swap_free(size_t used_index);
+void swap_write_slot(size_t slot, void *kaddr);
+void swap_print_stats(void);
 
 #endif 
@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <string.h>
+#include <hash.h>
+#include <list.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "vm/swap.h"
+#include "vm/zswap.h"
+
+/* A swap slot whose page is held compressed in memory.  The slot
+   stays allocated on disk, so an entry that ages out of the cache
+   is written back there */
+struct zswap_entry
+{
+	size_t slot;
+	size_t size;				/* bytes in data */
+	struct hash_elem elem;			/* element in zswap_table */
+	struct list_elem lru_elem;		/* element in zswap_lru, oldest first */
+	uint8_t data[];
+};
+
+/* pages that compress worse than this go to disk; it also keeps an
+   entry within one of malloc()'s arena block sizes */
+#define ZSWAP_MAX_SIZE (PGSIZE / 2 - sizeof(struct zswap_entry))
+
+size_t zswap_max_pages = 64;
+
+static struct hash zswap_table;
+static struct list zswap_lru;
+static size_t zswap_bytes;			/* bytes held in entries */
+
+/* scratch page for compression output */
+static uint8_t *zswap_buf;
+
+/* scratch page for write-back, which zswap_store() may do while
+   zswap_buf holds the page it is storing */
+static uint8_t *writeback_buf;
+
+/* statistics */
+static long long store_cnt, reject_cnt, load_cnt, miss_cnt, writeback_cnt, invalidate_cnt;
+static long long bytes_in, bytes_out;
+
+/* LZF-style compression.  A control byte below 32 starts a run of
+   that many plus one literal bytes.  Otherwise its top three bits
+   hold the match length minus 2 (7 means another length byte
+   follows) and its low five bits, with the byte after, hold the
+   distance back minus 1 */
+#define HASH_LOG 12
+#define MAX_LIT 32
+#define MAX_OFF (1 << 13)
+#define MAX_REF ((1 << 8) + (1 << 3))
+
+static uint16_t hash_tab[1 << HASH_LOG];	/* position + 1, 0 if none */
+
+static unsigned lzf_hash(const uint8_t *p)
+{
+	return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - HASH_LOG);
+}
+
+/* compress IN_LEN bytes from IN to OUT.  Returns the compressed
+   size, or 0 if it would not fit in OUT_LEN bytes */
+static size_t lzf_compress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len)
+{
+	const uint8_t *ip = in, *in_end = in + in_len;
+	uint8_t *op = out, *out_end = out + out_len;
+	uint8_t *lit_ctl;
+	int lit = 0;
+
+	memset(hash_tab, 0, sizeof hash_tab);
+	if(op >= out_end)
+		return 0;
+	lit_ctl = op++;
+
+	while(ip < in_end)
+	{
+		if(ip + 2 < in_end)
+		{
+			unsigned h = lzf_hash(ip);
+			const uint8_t *ref = in + hash_tab[h] - 1;
+			size_t off = ip - ref - 1;
+
+			hash_tab[h] = ip - in + 1;
+			if(ref >= in && off < MAX_OFF
+			   && ref[0] == ip[0] && ref[1] == ip[1] && ref[2] == ip[2])
+			{
+				size_t len = 3, max = in_end - ip < MAX_REF ? (size_t)(in_end - ip) : MAX_REF;
+
+				while(len < max && ref[len] == ip[len])
+					len++;
+
+				/* end the literal run, dropping its control byte if empty */
+				if(lit > 0)
+					*lit_ctl = lit - 1;
+				else
+					op--;
+
+				if(op + 3 + 1 > out_end)
+					return 0;
+				len -= 2;
+				if(len < 7)
+					*op++ = (off >> 8) + (len << 5);
+				else
+				{
+					*op++ = (off >> 8) + (7 << 5);
+					*op++ = len - 7;
+				}
+				*op++ = off;
+
+				lit = 0;
+				lit_ctl = op++;
+				ip += len + 2;
+				continue;
+			}
+		}
+
+		if(op >= out_end)
+			return 0;
+		*op++ = *ip++;
+		if(++lit == MAX_LIT)
+		{
+			*lit_ctl = lit - 1;
+			lit = 0;
+			if(op >= out_end)
+				return 0;
+			lit_ctl = op++;
+		}
+	}
+
+	if(lit > 0)
+		*lit_ctl = lit - 1;
+	else
+		op--;
+	return op - out;
+}
+
+/* decompress IN_LEN bytes from IN, which must expand to exactly
+   OUT_LEN bytes at OUT */
+static bool lzf_decompress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len)
+{
+	const uint8_t *ip = in, *in_end = in + in_len;
+	uint8_t *op = out, *out_end = out + out_len;
+
+	while(ip < in_end)
+	{
+		unsigned ctl = *ip++;
+
+		if(ctl < MAX_LIT)
+		{
+			ctl++;
+			if(op + ctl > out_end || ip + ctl > in_end)
+				return false;
+			memcpy(op, ip, ctl);
+			op += ctl;
+			ip += ctl;
+		}
+		else
+		{
+			unsigned len = ctl >> 5;
+			const uint8_t *ref;
+
+			if(len == 7)
+			{
+				if(ip >= in_end)
+					return false;
+				len += *ip++;
+			}
+			len += 2;
+			if(ip >= in_end)
+				return false;
+			ref = op - ((ctl & 0x1f) << 8) - 1 - *ip++;
+			if(ref < out || op + len > out_end)
+				return false;
+
+			/* byte by byte: the match may overlap its own output */
+			while(len-- > 0)
+				*op++ = *ref++;
+		}
+	}
+	return op == out_end;
+}
+
+static unsigned zswap_hash_func(const struct hash_elem *e, void *aux UNUSED)
+{
+	return hash_int(hash_entry(e, struct zswap_entry, elem)->slot);
+}
+
+static bool zswap_less_func(const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED)
+{
+	return hash_entry(a, struct zswap_entry, elem)->slot < hash_entry(b, struct zswap_entry, elem)->slot;
+}
+
+static struct zswap_entry *zswap_find(size_t slot)
+{
+	struct zswap_entry key;
+	struct hash_elem *e;
+
+	key.slot = slot;
+	e = hash_find(&zswap_table, &key.elem);
+	return e != NULL ? hash_entry(e, struct zswap_entry, elem) : NULL;
+}
+
+static void zswap_remove(struct zswap_entry *z)
+{
+	hash_delete(&zswap_table, &z->elem);
+	list_remove(&z->lru_elem);
+	zswap_bytes -= sizeof *z + z->size;
+	free(z);
+}
+
+/* write the oldest entry back to its slot on disk and drop it */
+static void zswap_writeback(void)
+{
+	struct zswap_entry *z = list_entry(list_front(&zswap_lru), struct zswap_entry, lru_elem);
+
+	if(!lzf_decompress(z->data, z->size, writeback_buf, PGSIZE))
+		PANIC("zswap: slot %zu is corrupt", z->slot);
+	swap_write_slot(z->slot, writeback_buf);
+	zswap_remove(z);
+	writeback_cnt++;
+}
+
+void zswap_init(void)
+{
+	hash_init(&zswap_table, zswap_hash_func, zswap_less_func, NULL);
+	list_init(&zswap_lru);
+	zswap_buf = palloc_get_page(0);
+	writeback_buf = palloc_get_page(0);
+	if(zswap_buf == NULL || writeback_buf == NULL)
+		zswap_max_pages = 0;
+}
+
+/* keep the page at KADDR, just written to SLOT, in memory instead of
+   on disk if it compresses well.  Older entries are written back to
+   make room.  Returns false if the caller must write the page to
+   disk itself */
+bool zswap_store(size_t slot, const void *kaddr)
+{
+	struct zswap_entry *z;
+	size_t size;
+
+	if(zswap_max_pages == 0)
+		return false;
+
+	size = lzf_compress(kaddr, PGSIZE, zswap_buf, ZSWAP_MAX_SIZE);
+	if(size == 0)
+	{
+		reject_cnt++;
+		return false;
+	}
+
+	while(!list_empty(&zswap_lru)
+	      && zswap_bytes + sizeof *z + size > zswap_max_pages * PGSIZE)
+		zswap_writeback();
+	if(sizeof *z + size > zswap_max_pages * PGSIZE)
+		return false;
+
+	z = malloc(sizeof *z + size);
+	if(z == NULL)
+		return false;
+	z->slot = slot;
+	z->size = size;
+	memcpy(z->data, zswap_buf, size);
+	hash_insert(&zswap_table, &z->elem);
+	list_push_back(&zswap_lru, &z->lru_elem);
+	zswap_bytes += sizeof *z + size;
+
+	store_cnt++;
+	bytes_in += PGSIZE;
+	bytes_out += size;
+	return true;
+}
+
+/* decompress SLOT's page into KADDR if the cache holds it.  The
+   entry stays until the slot is freed, since fork may share it */
+bool zswap_load(size_t slot, void *kaddr)
+{
+	struct zswap_entry *z = zswap_find(slot);
+
+	if(z == NULL)
+	{
+		miss_cnt++;
+		return false;
+	}
+	if(!lzf_decompress(z->data, z->size, kaddr, PGSIZE))
+		PANIC("zswap: slot %zu is corrupt", slot);
+	load_cnt++;
+	return true;
+}
+
+/* forget SLOT, which is no longer in use */
+void zswap_invalidate(size_t slot)
+{
+	struct zswap_entry *z = zswap_find(slot);
+
+	if(z != NULL)
+	{
+		zswap_remove(z);
+		invalidate_cnt++;
+	}
+}
+
+/* print zswap statistics */
+void zswap_print_stats(void)
+{
+	long long lookups = load_cnt + miss_cnt;
+
+	printf("Zswap: %lld pages stored at %lld%% of their size, %lld incompressible, "
+	       "%lld%% hit rate, %lld written back, %lld freed unwritten, "
+	       "%lld disk sectors not written\n",
+	       store_cnt, bytes_in > 0 ? bytes_out * 100 / bytes_in : 0, reject_cnt,
+	       lookups > 0 ? load_cnt * 100 / lookups : 0, writeback_cnt, invalidate_cnt,
+	       (store_cnt - writeback_cnt) * SECTORS_PER_PAGE);
+}
@@ -0,0 +1,19 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* compressed cache of swap slots kept in kernel memory in front of
+   the swap disk.  All functions must be called with swap_lock held */
+
+/* budget in pages of kernel memory, 0 disables the cache */
+extern size_t zswap_max_pages;
+
+void zswap_init(void);
+bool zswap_store(size_t slot, const void *kaddr);
+bool zswap_load(size_t slot, void *kaddr);
+void zswap_invalidate(size_t slot);
+void zswap_print_stats(void);
+
+#endif